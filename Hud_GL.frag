@@ -0,0 +1,16 @@
+#version 330 core
+
+in vec2 atlasUV;
+
+uniform sampler2D atlas;
+uniform vec3 textColor;
+
+out vec3 color;
+
+void main()
+{
+    // The atlas is one channel, lit or not
+    if(texture(atlas, atlasUV).r < 0.5)
+        discard;
+    color = textColor;
+}
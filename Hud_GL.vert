@@ -0,0 +1,16 @@
+#version 330 core
+
+// HUD quads: position in pixels, texture coordinates into the glyph atlas
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 1) in vec3 vertexUV;
+
+// pixels to clip space
+uniform mat4 MVP;
+
+out vec2 atlasUV;
+
+void main ()
+{
+    atlasUV = vertexUV.xy;
+    gl_Position = MVP * vec4(vertexPosition, 1);
+}
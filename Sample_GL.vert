@@ -3,6 +3,10 @@
 // input data : sent from main program
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexColor;
+// per-instance offset for the debris, split by coordinate; 0 for everything else
+layout (location = 2) in float instanceX;
+layout (location = 3) in float instanceY;
+layout (location = 4) in float instanceZ;
 
 uniform mat4 MVP;
 
@@ -11,7 +15,7 @@ out vec3 fragColor;
 
 void main ()
 {
-    vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+    vec4 v = vec4(vertexPosition + vec3(instanceX, instanceY, instanceZ), 1); // Transform an homogeneous 4D vector
 
     // The color of each vertex will be interpolated
     // to produce the color of each fragment
@@ -0,0 +1,158 @@
+/* Difficulty metrics for every level in a directory, as CSV.
+ *
+ *   analyze [-j threads] [-o out.csv] [-n] [dir]
+ *
+ * Each levelNN.txt is solved with solveLevel(), which plays the moves
+ * through moveBlock(), so the numbers follow the same tile rules as the
+ * game. Levels are analysed in parallel; rows come out in file name order.
+ * Results come from the solution cache (solvecache.h) when the level hasn't
+ * changed since it was last solved; -n solves everything again.
+ *
+ *   reachable_states  live block poses x switch states reachable from 'S'
+ *   avg_branching     moves per reachable state that don't fall
+ *   dead_end_ratio    reachable states the goal can no longer be reached from
+ *   fall_ratio        moves from reachable states that fall
+ *   switch_toggles    switch flips along the optimal solution
+ *   forced_fragile    fragile tiles without which the level can't be solved
+ */
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include <dirent.h>
+
+#include "rules.h"
+#include "solver.h"
+#include "solvecache.h"
+
+using namespace std;
+
+struct LevelReport {
+    string name;
+    int loaded;
+    SolveResult result;
+    int toggles, fragiles, forcedFragile;
+};
+
+static void analyzeLevel(const string &dir, LevelReport *r)
+{
+    GameState start;
+    r->loaded = loadLevel(&start, (dir + "/" + r->name).c_str());
+    if(!r->loaded)
+        return;
+    cachedSolve(&start, &r->result);
+
+    // Replay the solution to count switch flips
+    r->toggles = 0;
+    GameState s = start;
+    for(char key : r->result.path)
+    {
+        unsigned before = s.bridges;
+        moveKey(&s, key);
+        r->toggles += __builtin_popcount(before ^ s.bridges);
+    }
+
+    r->fragiles = r->forcedFragile = 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+        {
+            if(start.level[i][j] != T_FRAGILE)
+                continue;
+            r->fragiles++;
+            if(r->result.moves < 0)
+                continue;
+            GameState without = start;
+            without.level[i][j] = T_EMPTY;
+            SolveResult alt;
+            if(cachedSolve(&without, &alt, 0) < 0)
+                r->forcedFragile++;
+        }
+}
+
+static vector<string> levelFiles(const string &dir)
+{
+    vector<string> names;
+    DIR *d = opendir(dir.c_str());
+    if(!d)
+        return names;
+    while(struct dirent *e = readdir(d))
+    {
+        string name = e->d_name;
+        if(name.size() > 9 && !name.compare(0, 5, "level") && !name.compare(name.size()-4, 4, ".txt"))
+            names.push_back(name);
+    }
+    closedir(d);
+    sort(names.begin(), names.end());
+    return names;
+}
+
+int main (int argc, char** argv)
+{
+    int threads = thread::hardware_concurrency();
+    string dir = ".";
+    const char *outPath = NULL;
+
+    for(int i=1; i<argc; i++)
+    {
+        if(!strcmp(argv[i], "-j") && i+1 < argc)
+            threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-o") && i+1 < argc)
+            outPath = argv[++i];
+        else if(!strcmp(argv[i], "-n"))
+            disableSolveCache();
+        else
+            dir = argv[i];
+    }
+    if(threads < 1)
+        threads = 1;
+
+    vector<string> names = levelFiles(dir);
+    if(names.empty())
+    {
+        fprintf(stderr, "No level files in %s\n", dir.c_str());
+        return 2;
+    }
+    vector<LevelReport> reports(names.size());
+    for(size_t i=0; i<names.size(); i++)
+        reports[i].name = names[i];
+
+    atomic<size_t> nextLevel(0);
+    vector<thread> pool;
+    for(int t=0; t<threads && t<(int)names.size(); t++)
+        pool.push_back(thread([&]() {
+            size_t i;
+            while((i = nextLevel++) < reports.size())
+                analyzeLevel(dir, &reports[i]);
+        }));
+    for(auto &t : pool)
+        t.join();
+
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if(!out)
+    {
+        fprintf(stderr, "Could not open %s\n", outPath);
+        return 2;
+    }
+    fprintf(out, "level,solvable,optimal_moves,reachable_states,avg_branching,dead_end_ratio,fall_ratio,switch_toggles,fragile_tiles,forced_fragile,solution\n");
+    for(const LevelReport &r : reports)
+    {
+        if(!r.loaded)
+        {
+            fprintf(stderr, "Could not load %s\n", r.name.c_str());
+            continue;
+        }
+        const SolveResult &res = r.result;
+        double states = max(res.states, 1), tried = max(res.transitions, 1);
+        fprintf(out, "%s,%d,%d,%d,%.3f,%.3f,%.3f,%d,%d,%d,%s\n", r.name.c_str(), res.moves >= 0, res.moves,
+                res.states, (res.transitions - res.falls) / states, res.deadEnds / states,
+                res.falls / tried, r.toggles, r.fragiles, r.forcedFragile, res.path.c_str());
+    }
+    if(out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+#include "arena.h"
+
+using namespace std;
+
+void *arenaAlloc(Arena &a, size_t bytes, size_t align)
+{
+    for(;;)
+    {
+        if(a.block == a.blocks.size())
+        {
+            // Room for it even when malloc()'s alignment is less than align
+            size_t size = max((size_t)ARENA_BLOCK, bytes + align);
+            char *p = (char*)malloc(size);
+            if(!p)
+                return NULL;
+            a.blocks.push_back(p);
+            a.sizes.push_back(size);
+            a.mallocs++;
+        }
+        uintptr_t base = (uintptr_t)a.blocks[a.block];
+        size_t at = ((base + a.used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+        if(at + bytes <= a.sizes[a.block])
+        {
+            a.inUse += at + bytes - a.used;
+            a.highWater = max(a.highWater, a.inUse);
+            a.used = at + bytes;
+            return a.blocks[a.block] + at;
+        }
+        // What's left of this block goes unused until the next reset
+        a.inUse += a.sizes[a.block] - a.used;
+        a.block++;
+        a.used = 0;
+    }
+}
+
+void arenaReset(Arena &a)
+{
+    if(a.blocks.size() > 1)
+    {
+        size_t total = arenaCapacity(a);
+        arenaFree(a);
+        a.blocks.push_back((char*)malloc(total));
+        a.sizes.push_back(total);
+        a.mallocs++;
+        if(!a.blocks[0])
+        {
+            a.blocks.clear();
+            a.sizes.clear();
+        }
+    }
+    a.block = 0;
+    a.used = 0;
+    a.inUse = 0;
+}
+
+void arenaFree(Arena &a)
+{
+    for(char *p : a.blocks)
+        free(p);
+    a.blocks.clear();
+    a.sizes.clear();
+    a.block = 0;
+    a.used = 0;
+    a.inUse = 0;
+}
+
+size_t arenaCapacity(const Arena &a)
+{
+    size_t total = 0;
+    for(size_t size : a.sizes)
+        total += size;
+    return total;
+}
@@ -0,0 +1,46 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+/* Bump allocator for data that lives exactly as long as something else,
+ * the level being played in the game's case.
+ *
+ * Allocating moves a pointer along a block; nothing is freed on its own.
+ * arenaReset() lets go of everything at once and keeps the blocks for next
+ * time. When the arena had to take more than one block, the reset merges
+ * them into one big enough for all of it, so once an arena has seen its
+ * biggest level it never calls malloc() again.
+ *
+ * Only for types that need no destructor. Not thread-safe.
+ */
+
+#define ARENA_BLOCK (1 << 20)
+
+struct Arena {
+    std::vector<char*> blocks;
+    std::vector<size_t> sizes;
+    size_t block = 0;           // the block being allocated from
+    size_t used = 0;            // bytes of it taken
+    size_t inUse = 0;           // bytes taken since the last reset, padding included
+    size_t highWater = 0;       // the most inUse has been
+    long long mallocs = 0;      // blocks ever allocated
+};
+
+void *arenaAlloc(Arena &a, size_t bytes, size_t align=alignof(std::max_align_t));
+
+template<typename T>
+T *arenaArray(Arena &a, size_t n)
+{
+    return (T*)arenaAlloc(a, n * sizeof(T), alignof(T));
+}
+
+/* Drop everything allocated from a at once */
+void arenaReset(Arena &a);
+/* Give the blocks back too */
+void arenaFree(Arena &a);
+/* Bytes held in blocks */
+size_t arenaCapacity(const Arena &a);
+
+#endif
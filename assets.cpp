@@ -0,0 +1,229 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include "assets.h"
+
+using namespace std;
+
+/**************************
+ * Build-time parser      *
+ **************************/
+
+/* readLevel() done by the compiler: the same grid and link lines, into
+   the same tiles, groups and start, plus checks it doesn't make. A level
+   that fails them stops the build, with the error's number in the message. */
+enum { LEVEL_OK, NO_START, TWO_STARTS, NO_GOAL, BAD_TILE, TOO_WIDE, TOO_TALL, BAD_LINK };
+
+struct BuiltLevel {
+    unsigned char tile[LEVEL_ROWS][LEVEL_COLS];
+    unsigned char group[LEVEL_ROWS][LEVEL_COLS];
+    int startRow, startCol;
+    int error;
+};
+
+constexpr int tileFor(char c)
+{
+    return c == 'o' ? T_TILE : c == 'S' ? T_START : c == 'T' ? T_GOAL : c == '.' ? T_FRAGILE :
+           c == 'h' ? T_HSWITCH : c == 's' ? T_SSWITCH : c == 'H' ? T_HBRIDGE : c == 'B' ? T_SBRIDGE :
+           c == '-' ? T_EMPTY : -1;
+}
+
+constexpr int isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+constexpr int startsWith(const char *c, const char *word)
+{
+    while(*word)
+        if(*c++ != *word++)
+            return 0;
+    return 1;
+}
+
+/* An integer as sscanf's " %d" reads it; returns 0 if there isn't one */
+constexpr int readInt(const char *&c, int &value)
+{
+    while(isSpace(*c))
+        c++;
+    int sign = 1;
+    if(*c == '-' || *c == '+')
+        sign = *c++ == '-' ? -1 : 1;
+    if(*c < '0' || *c > '9')
+        return 0;
+    value = 0;
+    while(*c >= '0' && *c <= '9')
+        value = 10*value + (*c++ - '0');
+    value *= sign;
+    return 1;
+}
+
+constexpr BuiltLevel buildLevel(const char *text)
+{
+    BuiltLevel b = {};
+    int starts = 0, goals = 0;
+    const char *c = text;
+    int i = 0;
+    while(i<LEVEL_ROWS && *c && !startsWith(c, "link"))
+    {
+        int j = 0;
+        while(j<LEVEL_COLS && *c && *c!='\n')
+        {
+            int t = tileFor(*c);
+            if(t < 0 && !(*c == '\r' && c[1] == '\n'))
+                b.error = BAD_TILE;
+            t = t < 0 ? T_EMPTY : t;
+            if(t == T_START)
+            {
+                b.startRow = i;
+                b.startCol = j;
+                starts++;
+            }
+            goals += t == T_GOAL;
+            b.tile[i][j] = t;
+            b.group[i][j] = defaultGroup(t);
+            c++; j++;
+        }
+        if(*c && *c!='\n' && *c!='\r')
+            b.error = TOO_WIDE;
+        while(*c && *c!='\n')
+            c++;
+        if(*c=='\n')
+            c++;
+        i++;
+    }
+
+    // Link lines, and cells carried on from them; a line of tiles past the
+    // grid is a row too many
+    while(*c)
+    {
+        if(startsWith(c, "link"))
+        {
+            // Like sscanf(), the cells may run on past the end of the line
+            const char *p = c + 4;
+            int group = 0, row = 0, col = 0;
+            if(!readInt(p, group) || group < 0 || group >= MAX_BRIDGE_GROUPS)
+                b.error = BAD_LINK;
+            while(b.error != BAD_LINK && readInt(p, row) && *p++ == ',' && readInt(p, col))
+            {
+                if(row < 0 || row >= LEVEL_ROWS || col < 0 || col >= LEVEL_COLS)
+                    continue;
+                int t = b.tile[row][col];
+                if(t == T_HSWITCH || t == T_SSWITCH || t == T_HBRIDGE || t == T_SBRIDGE)
+                    b.group[row][col] = group;
+            }
+        }
+        else if(tileFor(*c) >= 0)
+            b.error = TOO_TALL;
+        while(*c && *c!='\n')
+            c++;
+        if(*c)
+            c++;
+    }
+
+    if(!b.error)
+        b.error = !starts ? NO_START : starts > 1 ? TWO_STARTS : !goals ? NO_GOAL : LEVEL_OK;
+    return b;
+}
+
+/**************************
+ * Built-in files         *
+ **************************/
+
+struct Asset {
+    const char *name;
+    const char *text;
+};
+
+#if EMBED_ASSETS
+#define ASSET(name, text)
+#define LEVEL(name, text) static_assert(buildLevel(text).error == LEVEL_OK, name " is not a valid level");
+#include "assets.inc"
+#undef ASSET
+#undef LEVEL
+
+static const Asset texts[] = {
+#define ASSET(name, text) { name, text },
+#define LEVEL(name, text)
+#include "assets.inc"
+#undef ASSET
+#undef LEVEL
+    { NULL, NULL }
+};
+
+struct NamedLevel {
+    const char *name;
+    BuiltLevel level;
+};
+
+static constexpr NamedLevel levels[] = {
+#define ASSET(name, text)
+#define LEVEL(name, text) { name, buildLevel(text) },
+#include "assets.inc"
+#undef ASSET
+#undef LEVEL
+    { NULL, {} }
+};
+#else
+static const Asset texts[] = { { NULL, NULL } };
+static constexpr struct { const char *name; BuiltLevel level; } levels[] = { { NULL, {} } };
+#endif
+
+/* The name a file is built in under: its path without the directories */
+static const char *baseName(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+int assetLevel(GameState *s, const char *path)
+{
+    if(!access(path, F_OK))
+        return loadLevel(s, path);
+    for(int k=0; levels[k].name; k++)
+        if(!strcmp(levels[k].name, baseName(path)))
+        {
+            const BuiltLevel &b = levels[k].level;
+            memset(s, 0, sizeof(*s));
+            s->currblock = B_STANDING;
+            for(int i=0; i<LEVEL_ROWS; i++)
+                for(int j=0; j<LEVEL_COLS; j++)
+                {
+                    s->level[i][j] = b.tile[i][j];
+                    s->group[i][j] = b.group[i][j];
+                }
+            s->blockTransY = 4 - b.startRow;
+            s->blockTransX = 7 - b.startCol;
+            countGroups(s);
+            return 1;
+        }
+    return 0;
+}
+
+string assetText(const char *path, int *found)
+{
+    string text;
+    FILE *file = fopen(path, "r");
+    int ok = file != NULL;
+    if(file)
+    {
+        char buf[512];
+        size_t n;
+        while((n = fread(buf, 1, sizeof(buf), file)) > 0)
+            text.append(buf, n);
+        fclose(file);
+    }
+    else
+        for(int k=0; texts[k].name && !ok; k++)
+            if(!strcmp(texts[k].name, baseName(path)))
+            {
+                text = texts[k].text;
+                ok = 1;
+            }
+    if(found)
+        *found = ok;
+    return text;
+}
@@ -0,0 +1,28 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <string>
+
+#include "rules.h"
+
+/* Shaders and levels built into the game, so it starts from anywhere
+ * without reading a file.
+ *
+ * The makefile wraps the shader and level files into assets.inc and the
+ * levels are decoded into tile arrays while the game compiles; a level
+ * file that doesn't parse, has no start or goal, or has tiles the game
+ * doesn't know is a compile error. make EMBED=0 builds without them.
+ *
+ * A file of the same name in the working directory still wins over the
+ * built-in copy, so levels saved from the editor and shaders being worked
+ * on are picked up without rebuilding.
+ */
+
+/* The level at path: read from the file when there is one, else decoded
+   at build time. Returns 0 if neither has it, or the file has no start. */
+int assetLevel(GameState *s, const char *path);
+/* The text of the file at path, or of the copy built in. found is set to
+   whether either had it. */
+std::string assetText(const char *path, int *found=NULL);
+
+#endif
@@ -0,0 +1,468 @@
+/* Microbenchmarks for the per-level and per-frame CPU work.
+ *
+ *   benchmark [-t seconds] [filter]
+ *
+ * Every benchmark runs on generated boards of increasing size and prints
+ * one line with the best ns/op and allocs/op out of three runs, in a fixed
+ * format so two runs can be diffed. Only benchmarks whose name contains
+ * filter are run.
+ *
+ *   parse     readLevel() on the level text, as selectLevel() does
+ *   load      loadLevel() from a file, including the disk read
+ *   step      moveBlock() with checkGameOver()/checkSwitch()
+ *   gameover  checkGameOver() on its own
+ *   heatreplay  heatReplay() of one 32 key play with undo and redo
+ *   history   historyRecord() after every move, dropping old moves at the limit
+ *   undo      historyUndo() and historyRedo() of one move
+ *   levelload a level started again as the game does: its arena reset, the
+ *             level parsed and a fresh history, then a few moves
+ *   resume    readSave() of a save file, as a restart does
+ *   boardbuild  the whole board mesh, as on the first frame of a level, and
+ *               the triangles it came to
+ *   boardsync   the per-frame board mesh update, with bridges toggling
+ *   solve     solveLevel() from the start position
+ *   cachehit  cachedSolve() for a level already in the solution cache
+ *   particles one 60Hz frame of debris, for pools of 1k to 100k particles
+ *   hud       one frame of HUD text: five slots set, one of them changed
+ *   statsrecord  statsRecord() of one attempt, sealing blocks as it goes
+ *   statsquery   statsQuery() over a store of 10k to 1M attempts at 30 levels
+ */
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <new>
+
+#include <unistd.h>
+
+#include "rules.h"
+#include "scene.h"
+#include "solver.h"
+#include "solvecache.h"
+#include "particles.h"
+#include "history.h"
+#include "savestate.h"
+#include "hud.h"
+#include "statstore.h"
+#include "heatmap.h"
+
+using namespace std;
+
+/* Count every heap allocation made while a benchmark runs */
+static long long allocCount = 0;
+
+void *operator new(size_t n)
+{
+    allocCount++;
+    void *p = malloc(n ? n : 1);
+    if(!p)
+        throw bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+struct Board {
+    int rows, cols;
+    string text;
+    GameState state;
+};
+
+/* A rows x cols board of plain tiles with a sprinkling of every other tile
+   kind, starting in the middle. Bridges are laid out so that the block
+   never falls while it rolls up and down the start column. */
+static Board makeBoard(int rows, int cols)
+{
+    static const char extras[] = ".hsHB";
+    Board b;
+    b.rows = rows; b.cols = cols;
+    for(int i=0; i<LEVEL_ROWS; i++)
+    {
+        for(int j=0; j<cols; j++)
+        {
+            char c = '-';
+            if(i < rows)
+                c = (i*7 + j*3) % 11 == 0 && j != cols/2 ? extras[(i+j) % 5] : 'o';
+            b.text += c;
+        }
+        b.text += '\n';
+    }
+    b.text[(rows/2)*(cols+1) + cols/2] = 'S';
+    b.text[(rows-1)*(cols+1) + cols-1] = 'T';
+    readLevel(&b.state, b.text.c_str());
+    return b;
+}
+
+static double secondsPerRun = 0.2;
+static volatile int sink;
+
+struct Result {
+    double nsPerOp, allocsPerOp;
+};
+
+/* Time fn(iterations) until one batch takes long enough, then keep the
+   best of three batches */
+template<typename Fn>
+static Result measure(Fn fn)
+{
+    typedef chrono::steady_clock clock;
+    long long iters = 1;
+    for(;;)
+    {
+        auto begin = clock::now();
+        fn(iters);
+        double took = chrono::duration<double>(clock::now() - begin).count();
+        if(took >= secondsPerRun / 4 || iters >= (1LL << 40))
+            break;
+        iters *= took > 0 ? min(100.0, max(2.0, secondsPerRun / 4 / took * 1.2)) : 100;
+    }
+    Result best = { 1e300, 0 };
+    for(int rep=0; rep<3; rep++)
+    {
+        long long allocs = allocCount;
+        auto begin = clock::now();
+        fn(iters);
+        double took = chrono::duration<double>(clock::now() - begin).count();
+        double ns = took * 1e9 / iters;
+        if(ns < best.nsPerOp)
+        {
+            best.nsPerOp = ns;
+            best.allocsPerOp = (double)(allocCount - allocs) / iters;
+        }
+    }
+    return best;
+}
+
+static void print(const char *name, const Board &b, Result r)
+{
+    char label[64];
+    snprintf(label, sizeof(label), "%s/%dx%d", name, b.rows, b.cols);
+    printf("%-20s %12.1f ns/op %8.2f allocs/op\n", label, r.nsPerOp, r.allocsPerOp);
+}
+
+int main (int argc, char** argv)
+{
+    const char *filter = "";
+    for(int i=1; i<argc; i++)
+    {
+        if(!strcmp(argv[i], "-t") && i+1 < argc)
+            secondsPerRun = atof(argv[++i]);
+        else
+            filter = argv[i];
+    }
+
+    static const int sizes[][2] = { {3, 5}, {5, 10}, {8, 15}, {10, 20} };
+    vector<Board> boards;
+    for(auto &sz : sizes)
+        boards.push_back(makeBoard(sz[0], sz[1]));
+
+    printf("# %-18s %12s       %8s\n", "benchmark", "ns/op", "allocs/op");
+
+    if(strstr("parse", filter))
+        for(const Board &b : boards)
+            print("parse", b, measure([&](long long n) {
+                GameState s;
+                for(long long i=0; i<n; i++)
+                    sink = readLevel(&s, b.text.c_str());
+            }));
+
+    if(strstr("load", filter))
+        for(const Board &b : boards)
+        {
+            string path = "/tmp/bench-level-" + to_string(b.rows) + "x" + to_string(b.cols) + ".txt";
+            FILE *file = fopen(path.c_str(), "w");
+            if(!file)
+                continue;
+            fputs(b.text.c_str(), file);
+            fclose(file);
+            print("load", b, measure([&](long long n) {
+                GameState s;
+                for(long long i=0; i<n; i++)
+                    sink = loadLevel(&s, path.c_str());
+            }));
+            remove(path.c_str());
+        }
+
+    if(strstr("step", filter))
+        for(const Board &b : boards)
+            print("step", b, measure([&](long long n) {
+                // Roll up and back down the start column; never falls
+                GameState s = b.state;
+                for(long long i=0; i<n; i++)
+                {
+                    moveBlock(&s, (i & 2) ? -1 : 1, 0);
+                    s.endGame = 0;
+                }
+                sink = s.numOfSteps;
+            }));
+
+    if(strstr("gameover", filter))
+        for(const Board &b : boards)
+            print("gameover", b, measure([&](long long n) {
+                GameState s = b.state;
+                for(long long i=0; i<n; i++)
+                {
+                    checkGameOver(&s);
+                    s.endGame = 0;
+                }
+                sink = s.endGame;
+            }));
+
+    if(strstr("heatreplay", filter))
+        for(const Board &b : boards)
+        {
+            // Up and down the start column, with some undo and redo
+            static const char play[] = "UDUDUDUDUDUDUDUDuuuurrrrUDUDUDUD";
+            Heatmap h;
+            heatClear(h, "bench.txt");
+            vector<char> moves;
+            vector<HeatPose> poses;
+            print("heatreplay", b, measure([&](long long n) {
+                for(long long i=0; i<n; i++)
+                    heatReplay(&b.state, play, sizeof(play)-1, h, moves, poses);
+                sink = h.moves;
+            }));
+        }
+
+    if(strstr("history", filter))
+        for(const Board &b : boards)
+        {
+            // A small limit, so the cost of dropping old moves is included
+            History h;
+            Arena arena;
+            GameState s = b.state;
+            historyReset(h, &s, arena, 4096);
+            print("history", b, measure([&](long long n) {
+                for(long long i=0; i<n; i++)
+                {
+                    moveBlock(&s, (i & 2) ? -1 : 1, 0);
+                    s.endGame = 0;
+                    historyRecord(h, &s);
+                }
+                sink = h.current;
+            }));
+        }
+
+    if(strstr("undo", filter))
+        for(const Board &b : boards)
+        {
+            History h;
+            Arena arena;
+            GameState s = b.state;
+            historyReset(h, &s, arena);
+            moveBlock(&s, 1, 0);
+            historyRecord(h, &s);
+            print("undo", b, measure([&](long long n) {
+                for(long long i=0; i<n; i++)
+                {
+                    historyUndo(h, &s);
+                    historyRedo(h, &s);
+                }
+                sink = s.numOfSteps;
+            }));
+        }
+
+    if(strstr("levelload", filter))
+        for(const Board &b : boards)
+        {
+            Arena arena;
+            History h;
+            print("levelload", b, measure([&](long long n) {
+                GameState s;
+                for(long long i=0; i<n; i++)
+                {
+                    arenaReset(arena);
+                    readLevel(&s, b.text.c_str());
+                    historyReset(h, &s, arena);
+                    for(int k=0; k<8; k++)
+                    {
+                        moveBlock(&s, (k & 2) ? -1 : 1, 0);
+                        historyRecord(h, &s);
+                    }
+                }
+                sink = h.count;
+            }));
+            printf("# %-18s %12zu bytes high water %3lld blocks\n", (to_string(b.rows) + "x" + to_string(b.cols)).c_str(),
+                   arena.highWater, arena.mallocs);
+            arenaFree(arena);
+        }
+
+    if(strstr("resume", filter))
+        for(const Board &b : boards)
+        {
+            char path[] = "/tmp/bench-save-XXXXXX";
+            int fd = mkstemp(path);
+            if(fd < 0)
+                continue;
+            close(fd);
+            SaveExtras extras = { 1, 12.5f, 3, 0, 90 };
+            writeSave(path, &b.state, &extras);
+            print("resume", b, measure([&](long long n) {
+                GameState s;
+                for(long long i=0; i<n; i++)
+                    sink = readSave(path, &s, &extras);
+            }));
+            remove(path);
+        }
+
+    if(strstr("boardbuild", filter))
+        for(const Board &b : boards)
+        {
+            BoardMesh mesh;
+            vector<int> changed;
+            print("boardbuild", b, measure([&](long long n) {
+                for(long long i=0; i<n; i++)
+                {
+                    initBoardMesh(mesh);
+                    syncBoardMesh(&b.state, mesh, changed);
+                }
+                sink = changed.size();
+            }));
+            // Against the 12 a tile took as a slab of its own
+            int tiles = 0;
+            for(int i=0; i<LEVEL_ROWS; i++)
+                for(int j=0; j<LEVEL_COLS; j++)
+                    tiles += mesh.look[i][j] != LOOK_NONE;
+            printf("# %-18s %12d triangles %6d tiles\n", (to_string(b.rows) + "x" + to_string(b.cols)).c_str(), boardTriangles(mesh), tiles);
+        }
+
+    if(strstr("boardsync", filter))
+        for(const Board &b : boards)
+        {
+            BoardMesh mesh;
+            vector<int> changed;
+            GameState s = b.state;
+            initBoardMesh(mesh);
+            syncBoardMesh(&s, mesh, changed);
+            print("boardsync", b, measure([&](long long n) {
+                for(long long i=0; i<n; i++)
+                {
+                    // Every other frame a switch flips its bridges
+                    s.bridges = i & 1;
+                    syncBoardMesh(&s, mesh, changed);
+                }
+                sink = changed.size();
+            }));
+        }
+
+    if(strstr("solve", filter))
+        for(const Board &b : boards)
+            print("solve", b, measure([&](long long n) {
+                SolveResult r;
+                for(long long i=0; i<n; i++)
+                    sink = solveLevel(&b.state, &r);
+            }));
+
+    if(strstr("particles", filter))
+        for(int size : { 1000, 10000, 100000 })
+        {
+            // Kept full: whatever burns out is thrown again
+            Particles p;
+            initParticles(p, size);
+            emitParticles(p, 0, 0, 0, size);
+            Result r = measure([&](long long n) {
+                for(long long i=0; i<n; i++)
+                {
+                    updateParticles(p, 1/60.0f);
+                    emitParticles(p, 0, 0, 0, size);
+                }
+                sink = p.count;
+            });
+            char label[64];
+            snprintf(label, sizeof(label), "particles/%d", size);
+            printf("%-20s %12.1f ns/op %8.2f allocs/op\n", label, r.nsPerOp, r.allocsPerOp);
+        }
+
+    if(strstr("hud", filter))
+    {
+        HudText h;
+        initHud(h, 5);
+        char line[64];
+        Result r = measure([&](long long n) {
+            for(long long i=0; i<n; i++)
+            {
+                setHudText(h, 0, "LEVEL 4");
+                snprintf(line, sizeof(line), "STEPS %lld", i);
+                setHudText(h, 1, line);
+                setHudText(h, 2, "TIME 1:23");
+                setHudText(h, 3, "BRIDGES 0-");
+                setHudText(h, 4, "");
+                h.changed.clear();
+            }
+            sink = h.text[1].size();
+        });
+        printf("%-20s %12.1f ns/op %8.2f allocs/op\n", "hud", r.nsPerOp, r.allocsPerOp);
+    }
+
+    if(strstr("statsquery", filter) || strstr("statsrecord", filter))
+    {
+        char path[] = "/tmp/bench-stats-XXXXXX";
+        int fd = mkstemp(path);
+        if(fd >= 0)
+            close(fd);
+        if(fd >= 0 && statsOpen(path))
+        {
+            // A third of the attempts won, in 5 to 105 seconds
+            long long stored = 0;
+            auto record = [&]() {
+                statsRecord(stored % 30, stored % 3 == 0, 20 + stored % 17, 5 + stored % 101);
+                stored++;
+            };
+            if(strstr("statsquery", filter))
+                for(long long size : { 10000LL, 100000LL, 1000000LL })
+                {
+                    while(stored < size)
+                        record();
+                    Result r = measure([&](long long n) {
+                        for(long long i=0; i<n; i++)
+                        {
+                            map<int, LevelStats> levels;
+                            statsQuery(path, levels);
+                            sink = levels.size();
+                        }
+                    });
+                    char label[64];
+                    snprintf(label, sizeof(label), "statsquery/%lldk", size / 1000);
+                    printf("%-20s %12.1f ns/op %8.2f allocs/op\n", label, r.nsPerOp, r.allocsPerOp);
+                }
+            if(strstr("statsrecord", filter))
+            {
+                Result r = measure([&](long long n) {
+                    for(long long i=0; i<n; i++)
+                        record();
+                });
+                printf("%-20s %12.1f ns/op %8.2f allocs/op\n", "statsrecord", r.nsPerOp, r.allocsPerOp);
+            }
+            statsClose();
+        }
+        remove(path);
+        remove((string(path) + ".tail").c_str());
+    }
+
+    if(strstr("cachehit", filter))
+    {
+        // A private cache directory, primed by the first call
+        char dir[] = "/tmp/bench-cache-XXXXXX";
+        if(mkdtemp(dir))
+        {
+            setenv("BLOX_CACHE", dir, 1);
+            for(const Board &b : boards)
+            {
+                SolveResult r;
+                cachedSolve(&b.state, &r);
+                print("cachehit", b, measure([&](long long n) {
+                    for(long long i=0; i<n; i++)
+                        sink = cachedSolve(&b.state, &r);
+                }));
+                char entry[64];
+                snprintf(entry, sizeof(entry), "%s/%016llx.bin", dir, (unsigned long long)levelHash(&b.state));
+                remove(entry);
+            }
+            rmdir(dir);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,372 @@
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "bloxenv.h"
+#include "rules.h"
+#include "solver.h"
+
+using namespace std;
+
+#define NEXT_FELL -1
+#define NEXT_WON  -2
+
+/* A level as a transition table over solver state keys, plus its static
+   observation planes for each setting of its bridge groups */
+struct EnvLevel {
+    int start, groups;
+    vector<int16_t> next;      // stateCount()*4: next key, NEXT_FELL or NEXT_WON
+    vector<uint8_t> planes;    // BLOX_OBS_BYTES for each bridges value
+};
+
+/* State keys have to fit the int16 tables */
+#define MAX_ENV_GROUPS 5
+
+struct Shard {
+    int begin, end;
+    uint64_t rng;
+};
+
+struct BloxEnv {
+    int numEnvs;
+    float winReward, fallReward, stepReward;
+    int maxSteps, autoReset;
+    vector<EnvLevel> levels;
+
+    // Per-environment state, one array per field
+    vector<int16_t> key, level;
+    vector<int32_t> steps;
+    vector<uint8_t> finished;
+
+    vector<Shard> shards;
+
+    // Worker threads run shards 1.. of each blox_step(); the caller runs 0
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake, idle;
+    long long generation;
+    int pending, quit;
+    const uint8_t *actions;
+    int16_t *pose;
+    uint8_t *planes;
+    float *rewards;
+    uint8_t *dones;
+};
+
+/* Row, column and orientation of every block pose (a state key without
+   its bridge bits) */
+static int16_t poseTable[POSE_COUNT][3];
+
+static void initPoseTable()
+{
+    static once_flag done;
+    call_once(done, []() {
+        GameState g;
+        memset(&g, 0, sizeof(g));
+        for(int k=0; k<POSE_COUNT; k++)
+        {
+            setState(&g, k);
+            poseTable[k][0] = blockRow(&g);
+            poseTable[k][1] = blockCol(&g);
+            poseTable[k][2] = g.currblock;
+        }
+    });
+}
+
+static inline uint64_t nextRandom(uint64_t &s)
+{
+    s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+    return s * 2685821657736338717ULL;
+}
+
+static inline void setBit(uint8_t *plane, int row, int col)
+{
+    if(row < 0 || row >= BLOX_ROWS || col < 0 || col >= BLOX_COLS)
+        return;
+    int cell = row*BLOX_COLS + col;
+    plane[cell >> 3] |= 1 << (cell & 7);
+}
+
+static void observe(const BloxEnv *env, int i, int16_t *pose, uint8_t *planes)
+{
+    const EnvLevel &lv = env->levels[env->level[i]];
+    int k = env->key[i];
+    int bridges = k & ((1 << lv.groups) - 1);
+    const int16_t *p = poseTable[k >> lv.groups];
+    if(pose)
+    {
+        int16_t *out = pose + (size_t)i*BLOX_POSE;
+        memcpy(out, p, 3*sizeof(int16_t));
+        out[3] = bridges;
+        out[4] = lv.groups;
+        out[5] = env->level[i];
+    }
+    if(planes)
+    {
+        uint8_t *out = planes + (size_t)i*BLOX_OBS_BYTES;
+        memcpy(out, &lv.planes[bridges*BLOX_OBS_BYTES], BLOX_OBS_BYTES);
+        uint8_t *block = out + 6*BLOX_PLANE_BYTES;
+        setBit(block, p[0], p[1]);
+        if(p[2] == B_ALONGY)
+            setBit(block, p[0]-1, p[1]);
+        else if(p[2] == B_ALONGX)
+            setBit(block, p[0], p[1]-1);
+    }
+}
+
+static void resetOne(BloxEnv *env, int i, uint64_t &rng)
+{
+    int lv = env->levels.size() > 1 ? (int)(nextRandom(rng) % env->levels.size()) : 0;
+    env->level[i] = lv;
+    env->key[i] = env->levels[lv].start;
+    env->steps[i] = 0;
+    env->finished[i] = 0;
+}
+
+static void stepShard(BloxEnv *env, int shard, const uint8_t *actions, int16_t *pose,
+                      uint8_t *planes, float *rewards, uint8_t *dones)
+{
+    Shard &sh = env->shards[shard];
+    const EnvLevel *levels = &env->levels[0];
+    int16_t *key = &env->key[0];
+    int16_t *level = &env->level[0];
+    int32_t *steps = &env->steps[0];
+    uint8_t *finished = &env->finished[0];
+
+    for(int i = sh.begin; i < sh.end; i++)
+    {
+        if(finished[i])
+        {
+            // Without auto-reset a finished environment just repeats itself
+            rewards[i] = 0;
+            dones[i] = finished[i];
+            observe(env, i, pose, planes);
+            continue;
+        }
+        int next = levels[level[i]].next[key[i]*4 + (actions[i] & 3)];
+        int done = BLOX_RUNNING;
+        steps[i]++;
+        if(next >= 0)
+        {
+            key[i] = next;
+            rewards[i] = env->stepReward;
+            if(env->maxSteps && steps[i] >= env->maxSteps)
+                done = BLOX_TRUNCATED;
+        }
+        else
+        {
+            rewards[i] = next == NEXT_WON ? env->winReward : env->fallReward;
+            done = BLOX_TERMINATED;
+        }
+        dones[i] = done;
+        if(done)
+        {
+            if(env->autoReset)
+                resetOne(env, i, sh.rng);
+            else
+                finished[i] = done;
+        }
+        observe(env, i, pose, planes);
+    }
+}
+
+static void workerLoop(BloxEnv *env, int shard)
+{
+    long long seen = 0;
+    for(;;)
+    {
+        {
+            unique_lock<mutex> guard(env->lock);
+            env->wake.wait(guard, [&]() { return env->quit || env->generation != seen; });
+            if(env->quit)
+                return;
+            seen = env->generation;
+        }
+        stepShard(env, shard, env->actions, env->pose, env->planes, env->rewards, env->dones);
+        {
+            lock_guard<mutex> guard(env->lock);
+            if(--env->pending == 0)
+                env->idle.notify_one();
+        }
+    }
+}
+
+extern "C" {
+
+BloxEnv *blox_create(int numEnvs, int numShards, uint64_t seed)
+{
+    if(numEnvs < 1 || numShards < 1)
+        return NULL;
+    if(numShards > numEnvs)
+        numShards = numEnvs;
+    initPoseTable();
+
+    BloxEnv *env = new BloxEnv;
+    env->numEnvs = numEnvs;
+    env->winReward = 1;
+    env->fallReward = -1;
+    env->stepReward = -0.01f;
+    env->maxSteps = 200;
+    env->autoReset = 1;
+    env->key.assign(numEnvs, 0);
+    env->level.assign(numEnvs, 0);
+    env->steps.assign(numEnvs, 0);
+    env->finished.assign(numEnvs, 0);
+    env->generation = 0;
+    env->pending = 0;
+    env->quit = 0;
+
+    for(int s = 0; s < numShards; s++)
+    {
+        Shard sh;
+        sh.begin = (long long)numEnvs * s / numShards;
+        sh.end = (long long)numEnvs * (s+1) / numShards;
+        sh.rng = seed * 0x9E3779B97F4A7C15ULL + s + 1;
+        env->shards.push_back(sh);
+    }
+    for(int s = 1; s < numShards; s++)
+        env->workers.push_back(thread(workerLoop, env, s));
+    return env;
+}
+
+void blox_destroy(BloxEnv *env)
+{
+    if(!env)
+        return;
+    {
+        lock_guard<mutex> guard(env->lock);
+        env->quit = 1;
+    }
+    env->wake.notify_all();
+    for(auto &t : env->workers)
+        t.join();
+    delete env;
+}
+
+int blox_add_level(BloxEnv *env, const char *text)
+{
+    GameState base;
+    if(!readLevel(&base, text) || base.groups > MAX_ENV_GROUPS)
+        return -1;
+
+    EnvLevel lv;
+    lv.start = stateKey(&base);
+    lv.groups = base.groups;
+    int count = stateCount(&base);
+    lv.next.assign(count*4, NEXT_FELL);
+    static const char keys[] = "UDRL";
+    for(int k = 0; k < count; k++)
+        for(int a = 0; a < 4; a++)
+        {
+            GameState g = base;
+            setState(&g, k);
+            moveKey(&g, keys[a]);
+            if(g.win)
+                lv.next[k*4 + a] = NEXT_WON;
+            else if(!g.endGame)
+                lv.next[k*4 + a] = stateKey(&g);
+        }
+
+    lv.planes.assign(BLOX_OBS_BYTES << lv.groups, 0);
+    for(int sw = 0; sw < (1 << lv.groups); sw++)
+    {
+        uint8_t *p = &lv.planes[sw*BLOX_OBS_BYTES];
+        for(int i = 0; i < BLOX_ROWS; i++)
+            for(int j = 0; j < BLOX_COLS; j++)
+            {
+                int t = base.level[i][j], plane = -1;
+                if(t == T_TILE || t == T_START)
+                    plane = 0;
+                else if(t == T_FRAGILE)
+                    plane = 1;
+                else if(t == T_GOAL)
+                    plane = 2;
+                else if(t == T_HSWITCH)
+                    plane = 3;
+                else if(t == T_SSWITCH)
+                    plane = 4;
+                else if((t == T_HBRIDGE || t == T_SBRIDGE) && ((sw >> base.group[i][j]) & 1))
+                    plane = 5;
+                if(plane >= 0)
+                    setBit(p + plane*BLOX_PLANE_BYTES, i, j);
+            }
+    }
+    env->levels.push_back(lv);
+    return env->levels.size() - 1;
+}
+
+void blox_configure(BloxEnv *env, float winReward, float fallReward, float stepReward,
+                    int maxSteps, int autoReset)
+{
+    env->winReward = winReward;
+    env->fallReward = fallReward;
+    env->stepReward = stepReward;
+    env->maxSteps = maxSteps;
+    env->autoReset = autoReset;
+}
+
+int blox_num_envs(const BloxEnv *env)
+{
+    return env->numEnvs;
+}
+
+int blox_num_shards(const BloxEnv *env)
+{
+    return env->shards.size();
+}
+
+int blox_shard_begin(const BloxEnv *env, int shard)
+{
+    if(shard >= (int)env->shards.size())
+        return env->numEnvs;
+    return env->shards[shard].begin;
+}
+
+void blox_reset(BloxEnv *env, int16_t *pose, uint8_t *planes)
+{
+    if(env->levels.empty())
+        return;
+    for(Shard &sh : env->shards)
+        for(int i = sh.begin; i < sh.end; i++)
+        {
+            resetOne(env, i, sh.rng);
+            observe(env, i, pose, planes);
+        }
+}
+
+void blox_step_shard(BloxEnv *env, int shard, const uint8_t *actions, int16_t *pose,
+                     uint8_t *planes, float *rewards, uint8_t *dones)
+{
+    if(env->levels.empty() || shard < 0 || shard >= (int)env->shards.size())
+        return;
+    stepShard(env, shard, actions, pose, planes, rewards, dones);
+}
+
+void blox_step(BloxEnv *env, const uint8_t *actions, int16_t *pose, uint8_t *planes,
+               float *rewards, uint8_t *dones)
+{
+    if(env->levels.empty())
+        return;
+    if(!env->workers.empty())
+    {
+        lock_guard<mutex> guard(env->lock);
+        env->actions = actions;
+        env->pose = pose;
+        env->planes = planes;
+        env->rewards = rewards;
+        env->dones = dones;
+        env->pending = env->workers.size();
+        env->generation++;
+    }
+    env->wake.notify_all();
+    stepShard(env, 0, actions, pose, planes, rewards, dones);
+    if(!env->workers.empty())
+    {
+        unique_lock<mutex> guard(env->lock);
+        env->idle.wait(guard, [&]() { return env->pending == 0; });
+    }
+}
+
+}
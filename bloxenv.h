@@ -0,0 +1,91 @@
+/* Batched Bloxorz environments for reinforcement learning, with a C ABI
+ * (libbloxenv.so, see the makefile).
+ *
+ * One BloxEnv holds N environments stored as arrays, one entry per
+ * environment. blox_step() advances all of them with one action each and
+ * fills the observations, rewards and done flags for the whole batch.
+ * The moves follow the game's rules exactly: every level is turned into a
+ * transition table by playing each move from each position through
+ * moveBlock() once, when the level is added.
+ *
+ * Observations, per environment:
+ *   pose    BLOX_POSE int16: block row, column, orientation (1 standing,
+ *           2 lying along rows, 3 lying along columns), extended bridge
+ *           groups as a bitmask, the level's group count, level index
+ *   planes  BLOX_PLANES bit planes of BLOX_PLANE_BYTES each, cell
+ *           row*BLOX_COLS+col in bit (cell%8) of byte cell/8: floor,
+ *           fragile, goal, hard switch, soft switch, extended bridge, block
+ * Either pointer may be NULL to skip it.
+ *
+ * Environments are split into shards of consecutive indices; blox_step()
+ * runs the shards on the env's worker threads, and blox_step_shard() lets a
+ * caller drive shards from its own threads (different shards only).
+ */
+#ifndef BLOXENV_H
+#define BLOXENV_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLOX_ROWS 10
+#define BLOX_COLS 20
+#define BLOX_PLANES 7
+#define BLOX_PLANE_BYTES ((BLOX_ROWS*BLOX_COLS + 7) / 8)
+#define BLOX_OBS_BYTES (BLOX_PLANES*BLOX_PLANE_BYTES)
+#define BLOX_POSE 6
+
+/* Actions: the arrow keys */
+#define BLOX_UP    0
+#define BLOX_DOWN  1
+#define BLOX_RIGHT 2
+#define BLOX_LEFT  3
+
+/* Values written to dones[] */
+#define BLOX_RUNNING    0
+#define BLOX_TERMINATED 1   // won or fell
+#define BLOX_TRUNCATED  2   // hit the step limit
+
+typedef struct BloxEnv BloxEnv;
+
+/* numEnvs environments split over numShards shards, run on as many
+   threads. Returns NULL on bad arguments. */
+BloxEnv *blox_create(int numEnvs, int numShards, uint64_t seed);
+void blox_destroy(BloxEnv *env);
+
+/* Add a level in the level file format; resets pick one of the added
+   levels at random. Returns the level index, or -1 if it doesn't parse or
+   links more than 5 bridge groups. */
+int blox_add_level(BloxEnv *env, const char *text);
+
+/* Rewards for winning, falling and every other move (default 1, -1, -0.01),
+   the episode step limit (default 200, 0 for none) and whether finished
+   environments reset themselves inside blox_step() (default on). With
+   auto-reset the observation written for a finished environment is the
+   first one of its next episode. */
+void blox_configure(BloxEnv *env, float winReward, float fallReward, float stepReward,
+                    int maxSteps, int autoReset);
+
+int blox_num_envs(const BloxEnv *env);
+int blox_num_shards(const BloxEnv *env);
+/* First environment of a shard; shard numShards gives numEnvs */
+int blox_shard_begin(const BloxEnv *env, int shard);
+
+/* Reset every environment and write its first observation */
+void blox_reset(BloxEnv *env, int16_t *pose, uint8_t *planes);
+
+/* Step every environment. All arrays are indexed by environment. */
+void blox_step(BloxEnv *env, const uint8_t *actions, int16_t *pose, uint8_t *planes,
+               float *rewards, uint8_t *dones);
+
+/* blox_step() for one shard; the arrays are still indexed by environment */
+void blox_step_shard(BloxEnv *env, int shard, const uint8_t *actions, int16_t *pose,
+                     uint8_t *planes, float *rewards, uint8_t *dones);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,229 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "capture.h"
+
+using namespace std;
+
+/**************************
+ * Encoders               *
+ **************************/
+
+struct CrcTable {
+    unsigned entry[256];
+    CrcTable() {
+        for(unsigned n=0; n<256; n++)
+        {
+            unsigned c = n;
+            for(int k=0; k<8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entry[n] = c;
+        }
+    }
+};
+
+static unsigned crc(unsigned c, const unsigned char *p, size_t n)
+{
+    static const CrcTable table;
+    c = ~c;
+    while(n--)
+        c = table.entry[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return ~c;
+}
+
+static void put32(vector<unsigned char> &out, unsigned v)
+{
+    unsigned char b[4] = { (unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v };
+    out.insert(out.end(), b, b+4);
+}
+
+static int writeChunk(FILE *file, const char *type, const unsigned char *data, size_t n)
+{
+    vector<unsigned char> head;
+    put32(head, n);
+    head.insert(head.end(), type, type+4);
+    unsigned c = crc(crc(0, head.data() + 4, 4), data, n);
+    vector<unsigned char> tail;
+    put32(tail, c);
+    return fwrite(head.data(), 1, 8, file) == 8 && fwrite(data, 1, n, file) == n && fwrite(tail.data(), 1, 4, file) == 4;
+}
+
+/* Rows are stored unfiltered in uncompressed deflate blocks: the files are
+   as big as the pixels, but writing one costs little more than a copy,
+   which is what matters while recording */
+int writePng(const char *path, int width, int height, const unsigned char *pixels)
+{
+    static vector<unsigned char> raw, stream;
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    size_t rowBytes = 3*(size_t)width;
+
+    // Each row behind a filter byte of 0, top down where glReadPixels()
+    // goes bottom up
+    raw.resize((rowBytes + 1) * height);
+    for(int y=0; y<height; y++)
+    {
+        raw[y*(rowBytes+1)] = 0;
+        memcpy(&raw[y*(rowBytes+1) + 1], pixels + (height-1-y) * rowBytes, rowBytes);
+    }
+
+    stream.clear();
+    stream.push_back(0x78);         // deflate, 32K window
+    stream.push_back(0x01);
+    for(size_t at=0; at<raw.size(); )
+    {
+        size_t n = min(raw.size() - at, (size_t)65535);
+        unsigned char block[5] = { (unsigned char)(at + n == raw.size()), (unsigned char)(n & 0xFF),
+                                   (unsigned char)(n >> 8), (unsigned char)(~n & 0xFF), (unsigned char)(~n >> 8 & 0xFF) };
+        stream.insert(stream.end(), block, block+5);
+        stream.insert(stream.end(), raw.begin() + at, raw.begin() + at + n);
+        at += n;
+    }
+    // Adler-32, reduced only as often as the sums could overflow
+    unsigned a = 1, b = 0;
+    for(size_t at=0; at<raw.size(); )
+    {
+        size_t end = min(raw.size(), at + 5552);
+        for(; at<end; at++)
+        {
+            a += raw[at];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    put32(stream, b << 16 | a);
+
+    vector<unsigned char> header;
+    put32(header, width);
+    put32(header, height);
+    const unsigned char rest[5] = { 8, 2, 0, 0, 0 };    // 8 bit RGB
+    header.insert(header.end(), rest, rest+5);
+
+    FILE *file = fopen(path, "wb");
+    if(!file)
+        return 0;
+    int ok = fwrite(signature, 1, 8, file) == 8 &&
+             writeChunk(file, "IHDR", header.data(), header.size()) &&
+             writeChunk(file, "IDAT", stream.data(), stream.size()) &&
+             writeChunk(file, "IEND", NULL, 0);
+    return fclose(file) == 0 && ok;
+}
+
+int writePpm(const char *path, int width, int height, const unsigned char *pixels)
+{
+    FILE *file = fopen(path, "wb");
+    if(!file)
+        return 0;
+    int ok = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+    size_t rowBytes = 3*(size_t)width;
+    for(int y=height-1; y>=0 && ok; y--)
+        ok = fwrite(pixels + y*rowBytes, 1, rowBytes, file) == rowBytes;
+    return fclose(file) == 0 && ok;
+}
+
+/**************************
+ * Writer thread          *
+ **************************/
+
+struct QueuedFrame {
+    string path;
+    int width, height;
+    vector<unsigned char> pixels;
+};
+
+static mutex queueLock;
+static condition_variable wake;
+static deque<QueuedFrame> queue;
+static vector<vector<unsigned char> > spare;    // buffers written out, to hand back
+static int running = 0;
+static thread writer;
+static CaptureStats stats;
+
+static void writeLoop()
+{
+    unique_lock<mutex> lock(queueLock);
+    for(;;)
+    {
+        wake.wait(lock, []() { return !queue.empty() || !running; });
+        if(queue.empty())
+            return;
+        QueuedFrame f;
+        swap(f, queue.front());
+        queue.pop_front();
+        lock.unlock();
+        size_t dot = f.path.rfind('.');
+        int png = dot != string::npos && !strcmp(f.path.c_str() + dot, ".png");
+        int ok = (png ? writePng : writePpm)(f.path.c_str(), f.width, f.height, f.pixels.data());
+        if(!ok)
+            fprintf(stderr, "Could not write %s\n", f.path.c_str());
+        lock.lock();
+        (ok ? stats.written : stats.failed)++;
+        spare.push_back(vector<unsigned char>());
+        swap(spare.back(), f.pixels);
+    }
+}
+
+void captureStart()
+{
+    lock_guard<mutex> guard(queueLock);
+    if(running)
+        return;
+    running = 1;
+    writer = thread(writeLoop);
+}
+
+void captureStop()
+{
+    {
+        lock_guard<mutex> guard(queueLock);
+        if(!running)
+            return;
+        running = 0;
+    }
+    wake.notify_one();
+    writer.join();
+}
+
+int captureSubmit(const string &path, int width, int height, vector<unsigned char> &pixels)
+{
+    {
+        lock_guard<mutex> guard(queueLock);
+        if(!running || queue.size() >= CAPTURE_QUEUE)
+        {
+            stats.droppedWriter++;
+            return 0;
+        }
+        queue.push_back(QueuedFrame());
+        QueuedFrame &f = queue.back();
+        f.path = path;
+        f.width = width;
+        f.height = height;
+        swap(f.pixels, pixels);
+        if(!spare.empty())
+        {
+            swap(pixels, spare.back());
+            spare.pop_back();
+        }
+        stats.captured++;
+    }
+    wake.notify_one();
+    return 1;
+}
+
+void captureDropped()
+{
+    lock_guard<mutex> guard(queueLock);
+    stats.droppedGpu++;
+}
+
+CaptureStats captureStats()
+{
+    lock_guard<mutex> guard(queueLock);
+    return stats;
+}
@@ -0,0 +1,45 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <string>
+#include <vector>
+
+/* Screenshots and recorded gameplay, written out off the game thread.
+ *
+ * The game reads frames back from the GPU without waiting for them (see
+ * the pixel buffer ring in game.cpp) and hands the pixels over here; a
+ * writer thread turns them into image files. A path ending in ".png" is
+ * written as a PNG, anything else as a binary PPM, which costs nothing to
+ * encode and suits long recordings.
+ *
+ * Nothing here ever makes the game wait. A frame is dropped, and counted,
+ * when the GPU side has no free buffer for it or the writer is
+ * CAPTURE_QUEUE frames behind.
+ */
+
+#define CAPTURE_QUEUE 8
+
+struct CaptureStats {
+    long long captured;         // handed to the writer
+    long long droppedGpu;       // no free pixel buffer to read into
+    long long droppedWriter;    // the writer was too far behind
+    long long written, failed;  // files
+};
+
+void captureStart();
+/* Writes out every frame already handed over */
+void captureStop();
+
+/* Hand over a frame of width x height RGB pixels, bottom row first as
+   glReadPixels() gives them. pixels is swapped for an old buffer to reuse,
+   so steady recording allocates nothing. Returns 0 if it was dropped. */
+int captureSubmit(const std::string &path, int width, int height, std::vector<unsigned char> &pixels);
+/* Count a frame dropped before it got here */
+void captureDropped();
+CaptureStats captureStats();
+
+/* The encoders, for bottom-up RGB pixels. Return 0 on failure. */
+int writePng(const char *path, int width, int height, const unsigned char *pixels);
+int writePpm(const char *path, int width, int height, const unsigned char *pixels);
+
+#endif
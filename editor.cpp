@@ -0,0 +1,122 @@
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+#include "editor.h"
+#include "solvecache.h"
+
+using namespace std;
+
+int placeTile(GameState *s, int row, int col, char key)
+{
+    const char *at = key ? strchr(EDITOR_TILES, key) : NULL;
+    if(!at || row < 0 || row >= LEVEL_ROWS || col < 0 || col >= LEVEL_COLS)
+        return 0;
+    static const int tiles[] = { T_TILE, T_FRAGILE, T_HSWITCH, T_SSWITCH, T_HBRIDGE, T_SBRIDGE, T_START, T_GOAL, T_EMPTY };
+    int tile = tiles[at - EDITOR_TILES];
+
+    if(tile == T_START)
+    {
+        for(int i=0; i<LEVEL_ROWS; i++)
+            for(int j=0; j<LEVEL_COLS; j++)
+                if(s->level[i][j] == T_START)
+                    s->level[i][j] = T_TILE;
+        s->blockTransY = 4 - row;
+        s->blockTransX = 7 - col;
+        s->currblock = B_STANDING;
+    }
+    s->level[row][col] = tile;
+    s->group[row][col] = defaultGroup(tile);
+    countGroups(s);
+    return 1;
+}
+
+int setGroup(GameState *s, int row, int col, int group)
+{
+    if(row < 0 || row >= LEVEL_ROWS || col < 0 || col >= LEVEL_COLS || group < 0 || group >= MAX_BRIDGE_GROUPS)
+        return 0;
+    int t = s->level[row][col];
+    if(t != T_HSWITCH && t != T_SSWITCH && t != T_HBRIDGE && t != T_SBRIDGE)
+        return 0;
+    s->group[row][col] = group;
+    countGroups(s);
+    return 1;
+}
+
+/* The checker keeps only the newest request: older ones are stale the
+   moment another edit lands */
+static mutex checkLock;
+static condition_variable checkWake;
+static thread checker;
+static GameState queued;
+static unsigned requested = 0, taken = 0;
+static int result = CHECK_PENDING, running = 0;
+static atomic<int> cancelCheck(0);
+
+static void checkLoop()
+{
+    SolveResult r;
+    for(;;)
+    {
+        GameState s;
+        unsigned gen;
+        {
+            unique_lock<mutex> guard(checkLock);
+            checkWake.wait(guard, []() { return !running || requested != taken; });
+            if(!running)
+                return;
+            s = queued;
+            gen = taken = requested;
+            cancelCheck = 0;
+        }
+
+        // Solved from 'S', wherever the block has got to while editing
+        int moves = resetToStart(&s) ? cachedSolve(&s, &r, 0, &cancelCheck) : CHECK_NO_START;
+
+        lock_guard<mutex> guard(checkLock);
+        if(gen == requested)
+            result = moves;
+    }
+}
+
+void startChecker()
+{
+    lock_guard<mutex> guard(checkLock);
+    if(running)
+        return;
+    running = 1;
+    checker = thread(checkLoop);
+}
+
+void stopChecker()
+{
+    {
+        lock_guard<mutex> guard(checkLock);
+        if(!running)
+            return;
+        running = 0;
+        cancelCheck = 1;
+    }
+    checkWake.notify_one();
+    checker.join();
+}
+
+void requestCheck(const GameState *s)
+{
+    {
+        lock_guard<mutex> guard(checkLock);
+        queued = *s;
+        requested++;
+        result = CHECK_PENDING;
+        cancelCheck = 1;
+    }
+    checkWake.notify_one();
+}
+
+int checkResult()
+{
+    lock_guard<mutex> guard(checkLock);
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include "rules.h"
+
+/* Tile characters the editor places, as in the level files */
+#define EDITOR_TILES "o.hsHBST-"
+
+/* Put the tile for key (one of EDITOR_TILES) at (row, col). There is only
+   one start: placing 'S' turns the old one into a plain tile and moves the
+   block there. Returns 0 if key isn't a tile. */
+int placeTile(GameState *s, int row, int col, char key);
+
+/* Move the switch or bridge at (row, col) to another group. Returns 0 if
+   there is no switch or bridge there. */
+int setGroup(GameState *s, int row, int col, int group);
+
+/* Solvability checks run on a background thread. requestCheck() queues
+   the level in s and cancels any check still running for an older edit.
+   The level is solved from its 'S' tile, not from where the block is. */
+void startChecker();
+void stopChecker();
+void requestCheck(const GameState *s);
+
+#define CHECK_PENDING  -3
+#define CHECK_NO_START -2
+#define CHECK_UNSOLVABLE -1
+
+/* Result for the latest requested level: optimal move count, or one of
+   CHECK_PENDING, CHECK_NO_START, CHECK_UNSOLVABLE */
+int checkResult();
+
+#endif
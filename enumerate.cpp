@@ -0,0 +1,743 @@
+/* Exhaustive search for the hardest small levels.
+ *
+ *   enumerate [-j threads] [-k kinds] [-n top] [-c checkpoint] [-i seconds] rows cols
+ *
+ * Every board up to rows x cols is built from the tile kinds in kinds (out
+ * of "-o.hsHB", default "-o") plus one 'S' and one 'T', solved, and the top
+ * best by optimal move count are printed as CSV, hardest first, with a
+ * solution. Switches and bridges are in their default groups.
+ *
+ * Each puzzle is only looked at once:
+ *   - a board must use its whole bounding box, so a shifted copy of a
+ *     smaller board is never seen again, and of two sizes that are each
+ *     other turned sideways only the wider is searched;
+ *   - of the boards that mirror or turn into each other only the one with
+ *     the smallest encoding is solved (the occupied cells as a bit mask,
+ *     then 'S', 'T' and the kinds of the other cells);
+ *   - a board with a cell that plays no part is the same puzzle as the one
+ *     without it, and is skipped: a tile no reachable position touches, a
+ *     fragile tile nothing ever stands on, or a switch that never fires.
+ * None of these checks keeps anything in memory. Results carry a 64 bit
+ * fingerprint of the board, so a work unit done twice (after resuming
+ * from a checkpoint taken while it ran) can't list a board twice.
+ *
+ * Boards are solved with a small model of the rules in rules.cpp, sized to
+ * the board and reusing its buffers, since moveBlock() on a whole
+ * GameState per move is far too slow for billions of boards. The final
+ * results are solved again with solveLevel(), and a disagreement is an
+ * error.
+ *
+ * The boards of each size are split into units that threads take in
+ * order, each a range of occupied-cell masks with 'S' on one cell, so even
+ * a size with few masks is spread over every thread. With -c the units
+ * done and the results so far are written to the checkpoint file every -i
+ * seconds (60 by default), on Ctrl-C and at the end; a run given an
+ * existing checkpoint carries on from it.
+ */
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rules.h"
+#include "solver.h"
+
+using namespace std;
+
+#define ENUM_VERSION 2
+
+/* Boards have to fit a level, and their masks a 64 bit word */
+#define MAX_CELLS 62
+#define PAD 2
+#define MAX_PADDED ((LEVEL_ROWS+2*PAD)*(LEVEL_COLS+2*PAD))
+#define MAX_STATES (MAX_PADDED*3*4)
+
+/* Masks per work unit, each once for every start cell */
+#define UNIT_BITS 20
+
+static const char tileChars[] = "-oST.hsHB";
+
+/**************************
+ * Board sizes            *
+ **************************/
+
+struct BoardSize {
+    int rows, cols, cells;
+    int syms;                       // symmetries of the rectangle, identity first
+    int perm[8][MAX_CELLS];         // cell q goes to perm[k][q]
+    int inverse[8][MAX_CELLS];
+    unsigned long long row0, rowLast, col0, colLast;
+    unsigned long long units, firstUnit;
+};
+
+static void initSize(BoardSize &b, int rows, int cols)
+{
+    b.rows = rows;
+    b.cols = cols;
+    b.cells = rows*cols;
+    b.syms = rows == cols ? 8 : 4;
+    for(int k=0; k<b.syms; k++)
+        for(int i=0; i<rows; i++)
+            for(int j=0; j<cols; j++)
+            {
+                // Mirror columns (bit 0), rows (bit 1), then transpose (bit 2)
+                int r = k & 2 ? rows-1-i : i, c = k & 1 ? cols-1-j : j;
+                int to = k & 4 ? c*cols + r : r*cols + c;
+                b.perm[k][i*cols + j] = to;
+                b.inverse[k][to] = i*cols + j;
+            }
+    b.row0 = b.rowLast = b.col0 = b.colLast = 0;
+    for(int j=0; j<cols; j++)
+    {
+        b.row0 |= 1ULL << j;
+        b.rowLast |= 1ULL << ((rows-1)*cols + j);
+    }
+    for(int i=0; i<rows; i++)
+    {
+        b.col0 |= 1ULL << (i*cols);
+        b.colLast |= 1ULL << (i*cols + cols-1);
+    }
+    b.units = (b.cells > UNIT_BITS ? 1ULL << (b.cells - UNIT_BITS) : 1) * b.cells;
+}
+
+static unsigned long long transformMask(const BoardSize &b, int k, unsigned long long m)
+{
+    unsigned long long t = 0;
+    for(; m; m &= m-1)
+        t |= 1ULL << b.perm[k][__builtin_ctzll(m)];
+    return t;
+}
+
+static int connected(const BoardSize &b, unsigned long long m)
+{
+    unsigned long long f = m & -m, grown;
+    for(;;)
+    {
+        grown = f | (f << 1 & ~b.col0) | (f >> 1 & ~b.colLast) | f << b.cols | f >> b.cols;
+        grown &= m;
+        if(grown == f)
+            return f == m;
+        f = grown;
+    }
+}
+
+/**************************
+ * Model of the rules     *
+ **************************/
+
+/* Cell flags gathered while solving, for the no-useless-cells check */
+#define F_TOUCHED 1     // under a reachable position, or the goal reached
+#define F_STOOD   2     // stood on in a reachable position
+#define F_LAIN    4     // lain on in a reachable position
+#define F_BROKE   8     // a fragile tile stood on from a reachable position
+
+/* One thread's board and search buffers. The board is padded by PAD empty
+   cells all round so no move can leave the array; positions are a padded
+   cell, the block's orientation (standing, along rows, along columns, as
+   B_ - 1) and the two switch group bits. */
+struct Search {
+    int width;                              // padded columns
+    unsigned char cell[MAX_PADDED];         // T_ codes
+    unsigned char flags[MAX_PADDED];
+    unsigned seen[MAX_STATES], epoch;
+    int queue[MAX_STATES];
+};
+
+/* The other cell a lying block covers */
+static int secondCell(const Search &s, int at, int o)
+{
+    return o == 1 ? at - s.width : at - 1;
+}
+
+static int supported(const Search &s, int at, int bridges)
+{
+    switch(s.cell[at]) {
+        case T_EMPTY:
+            return 0;
+        case T_HBRIDGE:
+            return bridges & 1;
+        case T_SBRIDGE:
+            return bridges >> 1 & 1;
+        default:
+            return 1;
+    }
+}
+
+/* Roll the block as moveKey() does for dir U, D, R, L. Returns 1 if it
+   lands alive, 0 if it falls and 2 on the goal. */
+static int roll(Search &s, int &at, int &o, int &bridges, int dir)
+{
+    int w = s.width;
+    // Row or column step, and whether dir is along the block's axis
+    int along = dir < 2 ? 1 : 2, step = dir == 0 ? -w : dir == 1 ? w : dir == 2 ? -1 : 1;
+    if(o == 0)
+    {
+        // Standing: lie down on the two cells that way
+        at += step < 0 ? step : 2*step;
+        o = along;
+    }
+    else if(o == along)
+    {
+        at += step < 0 ? 2*step : step;
+        o = 0;
+    }
+    else
+        at += step;
+
+    if(!supported(s, at, bridges))
+        return 0;
+    if(o == 0)
+    {
+        if(s.cell[at] == T_GOAL)
+            return 2;
+        if(s.cell[at] == T_FRAGILE)
+        {
+            s.flags[at] |= F_BROKE;
+            return 0;
+        }
+        if(s.cell[at] == T_HSWITCH)
+            bridges ^= 1;
+    }
+    else
+    {
+        int second = secondCell(s, at, o);
+        if(!supported(s, second, bridges))
+            return 0;
+        if(s.cell[at] == T_SSWITCH || s.cell[second] == T_SSWITCH)
+            bridges ^= 2;
+    }
+    return 1;
+}
+
+/* Breadth-first search from standing on start. Returns the optimal move
+   count or -1, and the live positions reached in *states. */
+static int solveModel(Search &s, int start, int goal, int *states)
+{
+    if(++s.epoch == 0)
+    {
+        memset(s.seen, 0, sizeof(s.seen));
+        s.epoch = 1;
+    }
+    int head = 0, tail = 0, depth = 0, levelEnd = 1, moves = -1;
+    s.queue[tail++] = start*12;
+    s.seen[start*12] = s.epoch;
+    while(head < tail)
+    {
+        if(head == levelEnd)
+        {
+            depth++;
+            levelEnd = tail;
+        }
+        int key = s.queue[head++];
+        int at0 = key / 12, o0 = key / 4 % 3, b0 = key & 3;
+        s.flags[at0] |= F_TOUCHED | (o0 ? F_LAIN : F_STOOD);
+        if(o0)
+            s.flags[secondCell(s, at0, o0)] |= F_TOUCHED | F_LAIN;
+        for(int dir=0; dir<4; dir++)
+        {
+            int at = at0, o = o0, b = b0;
+            int landed = roll(s, at, o, b, dir);
+            if(landed == 2)
+            {
+                if(moves < 0)
+                    moves = depth + 1;
+                s.flags[goal] |= F_TOUCHED;
+            }
+            if(landed != 1)
+                continue;
+            int next = (at*3 + o)*4 + b;
+            if(s.seen[next] != s.epoch)
+            {
+                s.seen[next] = s.epoch;
+                s.queue[tail++] = next;
+            }
+        }
+    }
+    *states = tail;
+    return moves;
+}
+
+/**************************
+ * Search                 *
+ **************************/
+
+struct Found {
+    int moves, states, tiles;
+    unsigned long long fingerprint;
+    int rows, cols;
+    string layout;                  // rows separated by '/'
+    string solution;
+};
+
+/* Hardest first; the fingerprint only makes the order total */
+static bool harder(const Found &a, const Found &b)
+{
+    if(a.moves != b.moves)
+        return a.moves > b.moves;
+    if(a.tiles != b.tiles)
+        return a.tiles < b.tiles;
+    return a.fingerprint < b.fingerprint;
+}
+
+struct Options {
+    string kinds;                   // tile kinds besides '-'
+    int top;
+    int maxRows, maxCols;
+    const char *checkpoint;
+    double interval;
+};
+
+static Options opt;
+static vector<BoardSize> sizes;
+static unsigned long long totalUnits;
+static volatile sig_atomic_t interrupted = 0;
+
+// Everything below is guarded by resultLock
+static mutex resultLock;
+static vector<Found> results;                   // sorted by harder()
+static unsigned long long doneBelow;            // every unit below is done
+static set<unsigned long long> doneAbove;
+static long long masksSeen, boardsSeen, boardsSolved;
+static atomic<int> entryMoves(0);               // moves the worst result has, once there are opt.top
+static atomic<unsigned long long> nextUnit(0);
+static atomic<int> workersLeft(0);
+
+static unsigned long long fnv(unsigned long long h, unsigned char byte)
+{
+    return (h ^ byte) * 1099511628211ULL;
+}
+
+/* Called with resultLock held */
+static void addResult(const Found &f)
+{
+    for(const Found &r : results)
+        if(r.fingerprint == f.fingerprint)
+            return;
+    results.insert(upper_bound(results.begin(), results.end(), f, harder), f);
+    if((int)results.size() > opt.top)
+        results.pop_back();
+    if((int)results.size() == opt.top)
+        entryMoves = results.back().moves;
+}
+
+/* Called with resultLock held */
+static void markDone(unsigned long long unit)
+{
+    doneAbove.insert(unit);
+    while(doneAbove.count(doneBelow))
+        doneAbove.erase(doneBelow++);
+}
+
+struct Counts {
+    long long masks, boards, solved;
+};
+
+/* Every board with occupied cells m and 'S' on cell startCell: 'T' and the
+   kinds of the rest */
+static void searchMask(Search &s, const BoardSize &b, unsigned long long m, int startCell, const int *selfSyms, int nSyms, Counts &n)
+{
+    int occ[MAX_CELLS], p = 0;
+    for(unsigned long long left = m; left; left &= left-1)
+        occ[p++] = __builtin_ctzll(left);
+
+    int kindCount = opt.kinds.size();
+    int codes[8];
+    for(int k=0; k<kindCount; k++)
+        codes[k] = strchr(tileChars, opt.kinds[k]) - tileChars;
+    int plain = opt.kinds.find('o') != string::npos;
+
+    // Board cell q is padded cell at[q]
+    int at[MAX_CELLS];
+    s.width = b.cols + 2*PAD;
+    memset(s.cell, 0, (b.rows + 2*PAD) * s.width);
+    for(int q=0; q<b.cells; q++)
+        at[q] = (q / b.cols + PAD) * s.width + q % b.cols + PAD;
+
+    unsigned char kind[MAX_CELLS];
+    memset(kind, 0, sizeof(kind));
+    int others[MAX_CELLS], digit[MAX_CELLS];
+    for(int si=0; si<p; si++)
+        for(int ti=0; ti<p; ti++)
+        {
+            if(occ[si] != startCell || ti == si || (kindCount == 0 && p > 2))
+                continue;
+            int start = occ[si], goal = occ[ti], o = 0;
+            for(int k=0; k<p; k++)
+                if(k != si && k != ti)
+                    others[o++] = occ[k];
+            kind[start] = T_START;
+            kind[goal] = T_GOAL;
+            for(int k=0; k<o; k++)
+            {
+                digit[k] = 0;
+                kind[others[k]] = codes[0];
+            }
+
+            for(;;)
+            {
+                n.boards++;
+                int skip = 0;
+
+                // Smallest of the board's mirror images and turns, for the
+                // symmetries that keep the mask
+                for(int k=0; k<nSyms && !skip; k++)
+                {
+                    const int *perm = b.perm[selfSyms[k]], *inv = b.inverse[selfSyms[k]];
+                    int d = perm[start] - start;
+                    if(!d)
+                        d = perm[goal] - goal;
+                    for(int q=0; !d && q<b.cells; q++)
+                        d = kind[inv[q]] - kind[q];
+                    skip = d < 0;
+                }
+
+                // A switch with no bridges of its group, or the other way
+                // round, plays as a tile or a hole
+                if(!skip && opt.kinds.find_first_of("hsHB") != string::npos)
+                {
+                    int count[9] = { 0 };
+                    for(int k=0; k<o; k++)
+                        count[kind[others[k]]]++;
+                    skip = !count[T_HSWITCH] != !count[T_HBRIDGE] || !count[T_SSWITCH] != !count[T_SBRIDGE];
+                }
+
+                if(!skip)
+                {
+                    for(int k=0; k<p; k++)
+                    {
+                        s.cell[at[occ[k]]] = kind[occ[k]];
+                        s.flags[at[occ[k]]] = 0;
+                    }
+                    int states;
+                    int moves = solveModel(s, at[start], at[goal], &states);
+                    if(moves >= 0)
+                    {
+                        n.solved++;
+                        // Every cell has to make a difference
+                        for(int k=0; k<p && !skip; k++)
+                        {
+                            int f = s.flags[at[occ[k]]], t = kind[occ[k]];
+                            skip = !(f & F_TOUCHED) ||
+                                   (plain && t == T_FRAGILE && !(f & F_BROKE)) ||
+                                   (plain && t == T_HSWITCH && !(f & F_STOOD)) ||
+                                   (plain && t == T_SSWITCH && !(f & F_LAIN));
+                        }
+                        if(!skip && moves >= entryMoves.load(memory_order_relaxed))
+                        {
+                            Found f;
+                            f.moves = moves;
+                            f.states = states;
+                            f.tiles = p;
+                            f.rows = b.rows;
+                            f.cols = b.cols;
+                            f.fingerprint = fnv(fnv(14695981039346656037ULL, b.rows), b.cols);
+                            for(int q=0; q<b.cells; q++)
+                            {
+                                f.fingerprint = fnv(f.fingerprint, kind[q]);
+                                if(q && q % b.cols == 0)
+                                    f.layout += '/';
+                                f.layout += tileChars[kind[q]];
+                            }
+                            lock_guard<mutex> guard(resultLock);
+                            addResult(f);
+                        }
+                    }
+                }
+
+                // Next kinds for the other cells
+                int k = 0;
+                while(k < o && ++digit[k] == kindCount)
+                {
+                    digit[k] = 0;
+                    kind[others[k]] = codes[0];
+                    k++;
+                }
+                if(k == o)
+                    break;
+                kind[others[k]] = codes[digit[k]];
+            }
+            kind[start] = kind[goal] = 0;
+        }
+}
+
+static void searchUnit(Search &s, unsigned long long unit, Counts &n)
+{
+    size_t z = 0;
+    while(z+1 < sizes.size() && sizes[z+1].firstUnit <= unit)
+        z++;
+    const BoardSize &b = sizes[z];
+    int startCell = (unit - b.firstUnit) % b.cells;
+    unsigned long long first = (unit - b.firstUnit) / b.cells << min(b.cells, UNIT_BITS);
+    unsigned long long end = first + (1ULL << min(b.cells, UNIT_BITS));
+    for(unsigned long long m = first; m < end && !interrupted; m++)
+    {
+        if(!(m >> startCell & 1) || !(m & b.row0) || !(m & b.rowLast) || !(m & b.col0) || !(m & b.colLast) || !connected(b, m))
+            continue;
+        int selfSyms[8], nSyms = 0, skip = 0;
+        for(int k=1; k<b.syms && !skip; k++)
+        {
+            unsigned long long t = transformMask(b, k, m);
+            skip = t < m;
+            if(t == m)
+                selfSyms[nSyms++] = k;
+        }
+        if(skip)
+            continue;
+        // Counted once, in the unit with 'S' on the mask's lowest cell
+        n.masks += startCell == __builtin_ctzll(m);
+        searchMask(s, b, m, startCell, selfSyms, nSyms, n);
+    }
+}
+
+static void worker()
+{
+    Search *s = new Search;
+    s->epoch = 0;
+    memset(s->seen, 0, sizeof(s->seen));
+    for(;;)
+    {
+        unsigned long long unit = nextUnit++;
+        if(unit >= totalUnits || interrupted)
+            break;
+        {
+            lock_guard<mutex> guard(resultLock);
+            if(unit < doneBelow || doneAbove.count(unit))
+                continue;
+        }
+        Counts n = { 0, 0, 0 };
+        searchUnit(*s, unit, n);
+        if(interrupted)
+            break;
+        lock_guard<mutex> guard(resultLock);
+        masksSeen += n.masks;
+        boardsSeen += n.boards;
+        boardsSolved += n.solved;
+        markDone(unit);
+    }
+    delete s;
+    workersLeft--;
+}
+
+/**************************
+ * Checkpoints            *
+ **************************/
+
+static string header()
+{
+    return "enumerate " + to_string(ENUM_VERSION) + " " + to_string(opt.maxRows) + "x" + to_string(opt.maxCols) + " -" + opt.kinds;
+}
+
+/* Called with resultLock held. Written next to the old checkpoint and
+   renamed over it, like a save. */
+static int writeCheckpoint()
+{
+    string text = header() + "\n";
+    text += "next " + to_string(doneBelow) + "\n";
+    for(unsigned long long u : doneAbove)
+        text += "done " + to_string(u) + "\n";
+    text += "counts " + to_string(masksSeen) + " " + to_string(boardsSeen) + " " + to_string(boardsSolved) + "\n";
+    for(const Found &f : results)
+    {
+        char line[64];
+        snprintf(line, sizeof(line), "result %d %d %d %016llx ", f.moves, f.states, f.tiles, f.fingerprint);
+        text += line + to_string(f.rows) + "x" + to_string(f.cols) + " " + f.layout + "\n";
+    }
+
+    string tmp = string(opt.checkpoint) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return 0;
+    int ok = write(fd, text.data(), text.size()) == (ssize_t)text.size();
+    ok &= fsync(fd) == 0;
+    ok &= close(fd) == 0;
+    if(!ok || rename(tmp.c_str(), opt.checkpoint) != 0)
+    {
+        unlink(tmp.c_str());
+        return 0;
+    }
+    return 1;
+}
+
+/* Returns 0 if there is a checkpoint but it is for another search */
+static int readCheckpoint()
+{
+    FILE *file = fopen(opt.checkpoint, "r");
+    if(!file)
+        return 1;
+    char line[1024], layout[1024];
+    int ok = fgets(line, sizeof(line), file) && string(line) == header() + "\n";
+    while(ok && fgets(line, sizeof(line), file))
+    {
+        unsigned long long u;
+        Found f;
+        if(sscanf(line, "next %llu", &u) == 1)
+            doneBelow = u;
+        else if(sscanf(line, "done %llu", &u) == 1)
+            doneAbove.insert(u);
+        else if(sscanf(line, "counts %lld %lld %lld", &masksSeen, &boardsSeen, &boardsSolved) == 3)
+            continue;
+        else if(sscanf(line, "result %d %d %d %llx %dx%d %1023s", &f.moves, &f.states, &f.tiles,
+                       &f.fingerprint, &f.rows, &f.cols, layout) == 7)
+        {
+            f.layout = layout;
+            addResult(f);
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+static void onInterrupt(int)
+{
+    interrupted = 1;
+}
+
+/**************************
+ * Main                   *
+ **************************/
+
+/* Solve a result again with the game's own rules */
+static int confirm(Found &f)
+{
+    string text = f.layout;
+    replace(text.begin(), text.end(), '/', '\n');
+    GameState s;
+    SolveResult r;
+    if(!readLevel(&s, text.c_str()) || solveLevel(&s, &r, 0) != f.moves || r.states != f.states)
+        return 0;
+    f.solution = r.path;
+    return 1;
+}
+
+int main (int argc, char** argv)
+{
+    int threads = thread::hardware_concurrency();
+    opt.kinds = "o";
+    opt.top = 20;
+    opt.checkpoint = NULL;
+    opt.interval = 60;
+    vector<int> dims;
+    for(int i=1; i<argc; i++)
+    {
+        if(!strcmp(argv[i], "-j") && i+1 < argc)
+            threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-k") && i+1 < argc)
+        {
+            opt.kinds.clear();
+            for(const char *c = argv[++i]; *c; c++)
+                if(*c != '-' && strchr("o.hsHB", *c) && opt.kinds.find(*c) == string::npos)
+                    opt.kinds += *c;
+                else if(*c != '-')
+                {
+                    fprintf(stderr, "Tile kinds are some of -o.hsHB\n");
+                    return 2;
+                }
+        }
+        else if(!strcmp(argv[i], "-n") && i+1 < argc)
+            opt.top = max(1, atoi(argv[++i]));
+        else if(!strcmp(argv[i], "-c") && i+1 < argc)
+            opt.checkpoint = argv[++i];
+        else if(!strcmp(argv[i], "-i") && i+1 < argc)
+            opt.interval = atof(argv[++i]);
+        else
+            dims.push_back(atoi(argv[i]));
+    }
+    if(threads < 1)
+        threads = 1;
+    if(dims.size() != 2 || dims[0] < 1 || dims[1] < 1 || dims[0] > LEVEL_ROWS || dims[1] > LEVEL_COLS)
+    {
+        fprintf(stderr, "usage: enumerate [-j threads] [-k kinds] [-n top] [-c checkpoint] [-i seconds] rows cols\n"
+                        "       (at most %dx%d)\n", LEVEL_ROWS, LEVEL_COLS);
+        return 2;
+    }
+    opt.maxRows = dims[0];
+    opt.maxCols = dims[1];
+
+    // Smaller boards first; of a size and the same turned sideways, only
+    // the wider one
+    for(int cells=2; cells<=opt.maxRows*opt.maxCols; cells++)
+        for(int rows=1; rows<=opt.maxRows; rows++)
+        {
+            int cols = cells / rows;
+            if(rows*cols != cells || cols > opt.maxCols || (rows > cols && cols <= opt.maxRows && rows <= opt.maxCols))
+                continue;
+            if(cells > MAX_CELLS)
+            {
+                fprintf(stderr, "Boards of more than %d cells are out of reach\n", MAX_CELLS);
+                return 2;
+            }
+            BoardSize b;
+            initSize(b, rows, cols);
+            b.firstUnit = totalUnits;
+            totalUnits += b.units;
+            sizes.push_back(b);
+        }
+
+    if(opt.checkpoint && !readCheckpoint())
+    {
+        fprintf(stderr, "%s is a checkpoint of another search\n", opt.checkpoint);
+        return 2;
+    }
+    if(doneBelow)
+        fprintf(stderr, "Resuming at unit %llu of %llu\n", doneBelow, totalUnits);
+    nextUnit = doneBelow;
+    signal(SIGINT, onInterrupt);
+
+    typedef chrono::steady_clock clock;
+    auto begin = clock::now();
+    long long boardsBefore = boardsSeen;
+    vector<thread> pool;
+    workersLeft = threads;
+    for(int t=0; t<threads; t++)
+        pool.push_back(thread(worker));
+    for(;;)
+    {
+        // Checkpoint and report progress while the workers run
+        auto wake = clock::now() + chrono::duration<double>(opt.interval);
+        while(clock::now() < wake && workersLeft)
+            this_thread::sleep_for(chrono::milliseconds(100));
+        lock_guard<mutex> guard(resultLock);
+        double took = chrono::duration<double>(clock::now() - begin).count();
+        fprintf(stderr, "%llu/%llu units, %lld boards (%.0f/s), %lld solvable\n", doneBelow + doneAbove.size(),
+                totalUnits, boardsSeen, (boardsSeen - boardsBefore) / max(took, 1e-9), boardsSolved);
+        if(opt.checkpoint && !writeCheckpoint())
+            fprintf(stderr, "Could not write %s\n", opt.checkpoint);
+        if(!workersLeft)
+            break;
+    }
+    for(thread &t : pool)
+        t.join();
+    if(interrupted)
+    {
+        lock_guard<mutex> guard(resultLock);
+        if(opt.checkpoint && !writeCheckpoint())
+            fprintf(stderr, "Could not write %s\n", opt.checkpoint);
+        fprintf(stderr, "Interrupted%s\n", opt.checkpoint ? ", run again to carry on" : "");
+        return 1;
+    }
+
+    printf("rank,moves,reachable_states,tiles,rows,cols,layout,solution\n");
+    int bad = 0;
+    for(size_t i=0; i<results.size(); i++)
+    {
+        Found &f = results[i];
+        if(!confirm(f))
+        {
+            fprintf(stderr, "%s: the rules disagree with the model\n", f.layout.c_str());
+            bad = 1;
+        }
+        printf("%zu,%d,%d,%d,%d,%d,%s,%s\n", i+1, f.moves, f.states, f.tiles, f.rows, f.cols, f.layout.c_str(), f.solution.c_str());
+    }
+    return bad;
+}
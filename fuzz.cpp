@@ -0,0 +1,540 @@
+/* Random-play fuzzer for the rules in rules.cpp.
+ *
+ * Every worker thread plays random and biased move sequences on the given
+ * levels (and optionally on randomly generated boards) and checks the state
+ * after every move against an independent model of the Bloxorz rules. When
+ * a check fails the move sequence is shrunk to a minimal one that still
+ * fails and written out so it can be replayed with -r.
+ *
+ *   fuzz [-j threads] [-t seconds] [-n runs] [-l maxlen] [-g]
+ *        [-s seed] [-o dir] [level.txt ...]
+ *   fuzz -r crash.txt
+ */
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "rules.h"
+
+using namespace std;
+
+/* xorshift64* - cheap enough to not show up next to moveBlock() */
+struct Rng {
+    unsigned long long s;
+    unsigned long long next() {
+        s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+        return s * 2685821657736338717ULL;
+    }
+    int below(int n) { return (int)((next() >> 33) % n); }
+};
+
+struct FuzzLevel {
+    string name;
+    string text;
+    GameState start;
+    int goalRow, goalCol;
+};
+
+/* Moves as keys, see moveKey() */
+static const char moveKeys[] = "UDRL";
+
+/**************************
+ * Reference model        *
+ **************************/
+
+/* The block as the one or two cells it covers, written independently of
+   rules.cpp: cells, not translations. (r0,c0) is the one moveBlock()
+   reports as (blockRow, blockCol). */
+struct Model {
+    int level[LEVEL_ROWS][LEVEL_COLS];
+    int group[LEVEL_ROWS][LEVEL_COLS];
+    int r0, c0, r1, c1;
+    unsigned bridges;
+    int ended, won, steps;
+};
+
+static int modelTile(const Model *m, int r, int c)
+{
+    if(r < 0 || r >= LEVEL_ROWS || c < 0 || c >= LEVEL_COLS)
+        return T_EMPTY;
+    return m->level[r][c];
+}
+
+static int solid(const Model *m, int r, int c)
+{
+    int t = modelTile(m, r, c);
+    if(t == T_EMPTY) return 0;
+    if(t == T_HBRIDGE || t == T_SBRIDGE)
+        return (m->bridges >> m->group[r][c]) & 1;
+    return 1;
+}
+
+static void modelStep(Model *m, char key)
+{
+    if(m->ended)
+        return;
+    // Rows grow downwards and "right" moves towards column 0
+    int dr = key=='U' ? -1 : key=='D' ? 1 : 0;
+    int dc = key=='R' ? -1 : key=='L' ? 1 : 0;
+    int standing = m->r0==m->r1 && m->c0==m->c1;
+
+    if(standing)
+    {
+        m->r0 += 2*dr; m->c0 += 2*dc;
+        m->r1 += dr; m->c1 += dc;
+    }
+    else if((m->r0 != m->r1 && dr) || (m->c0 != m->c1 && dc))
+    {
+        // Rolling along the long axis stands the block up past its far end
+        int r = dr < 0 ? min(m->r0, m->r1) : max(m->r0, m->r1);
+        int c = dc < 0 ? min(m->c0, m->c1) : max(m->c0, m->c1);
+        m->r0 = m->r1 = r + dr;
+        m->c0 = m->c1 = c + dc;
+    }
+    else
+    {
+        m->r0 += dr; m->r1 += dr;
+        m->c0 += dc; m->c1 += dc;
+    }
+    // Keep (r0,c0) as the lower/right-most cell to match blockRow/blockCol
+    if(m->r1 > m->r0 || m->c1 > m->c0)
+    {
+        swap(m->r0, m->r1);
+        swap(m->c0, m->c1);
+    }
+    m->steps++;
+
+    standing = m->r0==m->r1 && m->c0==m->c1;
+    if(!solid(m, m->r0, m->c0) || !solid(m, m->r1, m->c1))
+        m->ended = 1;
+    else if(standing && modelTile(m, m->r0, m->c0) == T_GOAL)
+        m->ended = m->won = 1;
+    else if(standing && modelTile(m, m->r0, m->c0) == T_FRAGILE)
+    {
+        m->ended = 1;
+        m->level[m->r0][m->c0] = T_EMPTY;
+    }
+
+    // A group toggles once however many of its switches the block covers
+    if(standing)
+    {
+        if(modelTile(m, m->r0, m->c0) == T_HSWITCH)
+            m->bridges ^= 1u << m->group[m->r0][m->c0];
+    }
+    else
+    {
+        unsigned flip = 0;
+        if(modelTile(m, m->r0, m->c0) == T_SSWITCH)
+            flip |= 1u << m->group[m->r0][m->c0];
+        if(modelTile(m, m->r1, m->c1) == T_SSWITCH)
+            flip |= 1u << m->group[m->r1][m->c1];
+        m->bridges ^= flip;
+    }
+}
+
+static void modelReset(Model *m, const GameState *s)
+{
+    memcpy(m->level, s->level, sizeof(m->level));
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            m->group[i][j] = s->group[i][j];
+    m->r0 = m->r1 = blockRow(s);
+    m->c0 = m->c1 = blockCol(s);
+    m->bridges = 0;
+    m->ended = m->won = m->steps = 0;
+}
+
+/* Compare the engine against the model; returns a description of the first
+   broken invariant or NULL */
+static const char *checkInvariants(const GameState *s, const Model *m, const GameState *start)
+{
+    if(s->currblock < B_STANDING || s->currblock > B_ALONGX)
+        return "currblock out of range";
+    if(s->bridges >> s->groups)
+        return "bridge bit outside the level's groups";
+    if(s->win && !s->endGame)
+        return "won without ending the game";
+    if(s->endGame != m->ended)
+        return "endGame differs from the model";
+    if(s->win != m->won)
+        return "win differs from the model";
+    if(s->numOfSteps != m->steps)
+        return "numOfSteps differs from the model";
+    if(blockRow(s) != m->r0 || blockCol(s) != m->c0)
+        return "block position differs from the model";
+    int standing = m->r0==m->r1 && m->c0==m->c1;
+    int expect = standing ? B_STANDING : (m->r0 != m->r1 ? B_ALONGY : B_ALONGX);
+    if(s->currblock != expect)
+        return "orientation differs from the model";
+    if(s->bridges != m->bridges)
+        return "switch state differs from the model";
+    if(memcmp(s->level, m->level, sizeof(m->level)))
+        return "board differs from the model";
+    // The editor's check solves from here, and must get the level's start
+    // and so the same verdict whatever moves were made
+    GameState reset = *s;
+    memcpy(reset.level, start->level, sizeof(reset.level));
+    if(!resetToStart(&reset) || memcmp(&reset, start, sizeof(reset)))
+        return "resetToStart() doesn't give back the start";
+    // Support is judged before switches toggle, so a block may stay on a
+    // bridge it has just retracted; it can never stay up off the board
+    if(!s->endGame)
+    {
+        if(modelTile(m, m->r0, m->c0) == T_EMPTY || modelTile(m, m->r1, m->c1) == T_EMPTY)
+            return "block standing off the board";
+    }
+    return NULL;
+}
+
+/* Replay keys from the start of lv; returns the failing step (1-based) and
+   sets *why, or 0 when every step passes */
+static int runKeys(const FuzzLevel &lv, const string &keys, const char **why)
+{
+    GameState s = lv.start;
+    Model m;
+    modelReset(&m, &s);
+    for(size_t i=0; i<keys.size(); i++)
+    {
+        moveKey(&s, keys[i]);
+        modelStep(&m, keys[i]);
+        if((*why = checkInvariants(&s, &m, &lv.start)))
+            return i+1;
+    }
+    return 0;
+}
+
+/* Greedily drop moves while the same invariant keeps failing */
+static string shrink(const FuzzLevel &lv, string keys, const char *why)
+{
+    const char *w;
+    int at = runKeys(lv, keys, &w);
+    keys.resize(at);
+    int changed = 1;
+    while(changed)
+    {
+        changed = 0;
+        for(size_t i=0; i<keys.size(); i++)
+        {
+            string shorter = keys.substr(0, i) + keys.substr(i+1);
+            int fail = runKeys(lv, shorter, &w);
+            if(fail && w == why)
+            {
+                keys = shorter.substr(0, fail);
+                changed = 1;
+                break;
+            }
+        }
+    }
+    return keys;
+}
+
+/**************************
+ * Move generation        *
+ **************************/
+
+enum { BIAS_UNIFORM, BIAS_MOMENTUM, BIAS_GOAL, BIAS_EDGE, BIAS_COUNT };
+
+static char pickKey(Rng &rng, int bias, const GameState *s, const FuzzLevel &lv, char last)
+{
+    if(bias == BIAS_MOMENTUM && last && rng.below(10) < 6)
+        return last;
+    if(bias == BIAS_GOAL && rng.below(10) < 7)
+    {
+        int dr = lv.goalRow - blockRow(s), dc = lv.goalCol - blockCol(s);
+        if(abs(dr) > abs(dc))
+            return dr < 0 ? 'U' : 'D';
+        return dc < 0 ? 'R' : 'L';
+    }
+    if(bias == BIAS_EDGE && rng.below(10) < 7)
+    {
+        // Head for whichever board edge is closest
+        int r = blockRow(s), c = blockCol(s);
+        int best = min(min(r, LEVEL_ROWS-1-r), min(c, LEVEL_COLS-1-c));
+        if(best == r) return 'U';
+        if(best == LEVEL_ROWS-1-r) return 'D';
+        if(best == c) return 'R';
+        return 'L';
+    }
+    return moveKeys[rng.below(4)];
+}
+
+/* A random board with tiles right up to the edges, so falls off every side
+   of the array get exercised */
+static FuzzLevel randomLevel(Rng &rng, int n)
+{
+    static const char kinds[] = "oooooo..hsHB-";
+    string text;
+    int rows = 1 + rng.below(LEVEL_ROWS), cols = 1 + rng.below(LEVEL_COLS);
+    for(int i=0; i<rows; i++)
+    {
+        for(int j=0; j<cols; j++)
+            text += kinds[rng.below(sizeof(kinds)-1)];
+        text += '\n';
+    }
+    int sr = rng.below(rows), sc = rng.below(cols);
+    text[sr*(cols+1) + sc] = 'S';
+    int tr = rng.below(rows), tc = rng.below(cols);
+    if(tr != sr || tc != sc)
+        text[tr*(cols+1) + tc] = 'T';
+    // Some boards move random cells to other bridge groups
+    for(int n = rng.below(4); n > 0; n--)
+    {
+        text += "link " + to_string(rng.below(MAX_BRIDGE_GROUPS));
+        for(int k = 1 + rng.below(4); k > 0; k--)
+            text += " " + to_string(rng.below(rows)) + "," + to_string(rng.below(cols));
+        text += '\n';
+    }
+
+    FuzzLevel lv;
+    lv.name = "random#" + to_string(n);
+    lv.text = text;
+    readLevel(&lv.start, text.c_str());
+    lv.goalRow = tr; lv.goalCol = tc;
+    return lv;
+}
+
+static void findGoal(FuzzLevel &lv)
+{
+    lv.goalRow = blockRow(&lv.start);
+    lv.goalCol = blockCol(&lv.start);
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            if(lv.start.level[i][j] == T_GOAL)
+            {
+                lv.goalRow = i;
+                lv.goalCol = j;
+            }
+}
+
+/**************************
+ * Driver                 *
+ **************************/
+
+struct FuzzOptions {
+    int threads, maxLen, randomBoards;
+    long long maxRuns;
+    double seconds;
+    unsigned long long seed;
+    string outDir;
+};
+
+static atomic<long long> runsDone(0), stepsDone(0), failures(0);
+static atomic<int> stopAll(0);
+static mutex reportLock;
+static set<string> reported;
+
+static void report(const FuzzLevel &lv, const string &keys, const char *why, const FuzzOptions &opt)
+{
+    lock_guard<mutex> lock(reportLock);
+    failures++;
+    string sig = lv.name + ": " + why;
+    if(!reported.insert(sig).second)
+        return;
+
+    string path = opt.outDir + "/crash-" + to_string(reported.size()) + ".txt";
+    FILE *file = fopen(path.c_str(), "w");
+    if(file)
+    {
+        fprintf(file, "# %s\n# level: %s\nmoves %s\n%s", why, lv.name.c_str(), keys.c_str(), lv.text.c_str());
+        fclose(file);
+    }
+    fprintf(stderr, "FAIL %s after %d moves: %s -> %s\n", sig.c_str(), (int)keys.size(), keys.c_str(), path.c_str());
+}
+
+static void worker(int id, const vector<FuzzLevel> *levels, const FuzzOptions *opt)
+{
+    Rng rng = { opt->seed * 0x9E3779B97F4A7C15ULL + id + 1 };
+    string keys;
+    keys.reserve(opt->maxLen);
+    long long runs = 0, steps = 0, randomRuns = 0;
+    int generated = 0;
+    FuzzLevel scratch;
+
+    while(!stopAll.load(memory_order_relaxed))
+    {
+        const FuzzLevel *lv;
+        if(opt->randomBoards && (levels->empty() || rng.below(2)))
+        {
+            if(randomRuns++ % 64 == 0)
+                scratch = randomLevel(rng, id*1000000 + generated++);
+            lv = &scratch;
+        }
+        else
+            lv = &(*levels)[rng.below(levels->size())];
+
+        GameState s = lv->start;
+        Model m;
+        modelReset(&m, &s);
+        int bias = rng.below(BIAS_COUNT);
+        int len = 1 + rng.below(opt->maxLen);
+        char last = 0;
+        keys.clear();
+        for(int i=0; i<len; i++)
+        {
+            char key = pickKey(rng, bias, &s, *lv, last);
+            keys += key;
+            last = key;
+            moveKey(&s, key);
+            modelStep(&m, key);
+            steps++;
+            const char *why = checkInvariants(&s, &m, &lv->start);
+            if(why)
+            {
+                report(*lv, shrink(*lv, keys, why), why, *opt);
+                break;
+            }
+            // A few moves past the end make sure the board stays frozen
+            if(s.endGame && rng.below(4) == 0)
+                break;
+        }
+
+        if(++runs % 1024 == 0)
+        {
+            runsDone += 1024;
+            stepsDone += steps;
+            steps = 0;
+            if(opt->maxRuns && runsDone >= opt->maxRuns)
+                stopAll = 1;
+        }
+    }
+    runsDone += runs % 1024;
+    stepsDone += steps;
+}
+
+static int replay(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if(!file)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return 2;
+    }
+    string keys, text;
+    char line[256];
+    while(fgets(line, sizeof(line), file))
+    {
+        if(line[0] == '#')
+            continue;
+        if(!strncmp(line, "moves ", 6))
+        {
+            keys = line + 6;
+            while(!keys.empty() && (keys.back() == '\n' || keys.back() == '\r'))
+                keys.pop_back();
+        }
+        else
+            text += line;
+    }
+    fclose(file);
+
+    FuzzLevel lv;
+    lv.name = path;
+    lv.text = text;
+    readLevel(&lv.start, text.c_str());
+    const char *why;
+    int at = runKeys(lv, keys, &why);
+    if(!at)
+    {
+        printf("%s: %d moves replayed, no invariant broken\n", path, (int)keys.size());
+        return 0;
+    }
+    printf("%s: move %d (%c) breaks: %s\n", path, at, keys[at-1], why);
+    return 1;
+}
+
+int main (int argc, char** argv)
+{
+    FuzzOptions opt;
+    opt.threads = thread::hardware_concurrency();
+    opt.maxLen = 200;
+    opt.randomBoards = 0;
+    opt.maxRuns = 0;
+    opt.seconds = 10;
+    opt.seed = chrono::steady_clock::now().time_since_epoch().count();
+    opt.outDir = ".";
+    vector<FuzzLevel> levels;
+
+    for(int i=1; i<argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = i+1 < argc ? argv[i+1] : NULL;
+        if(!strcmp(arg, "-r") && val)
+            return replay(val);
+        else if(!strcmp(arg, "-j") && val) { opt.threads = atoi(val); i++; }
+        else if(!strcmp(arg, "-t") && val) { opt.seconds = atof(val); i++; }
+        else if(!strcmp(arg, "-n") && val) { opt.maxRuns = atoll(val); i++; }
+        else if(!strcmp(arg, "-l") && val) { opt.maxLen = max(1, atoi(val)); i++; }
+        else if(!strcmp(arg, "-g")) opt.randomBoards = 1;
+        else if(!strcmp(arg, "-s") && val) { opt.seed = strtoull(val, NULL, 0); i++; }
+        else if(!strcmp(arg, "-o") && val) { opt.outDir = val; i++; }
+        else if(arg[0] == '-')
+        {
+            fprintf(stderr, "usage: fuzz [-j threads] [-t seconds] [-n runs] [-l maxlen] [-g]\n"
+                            "            [-s seed] [-o dir] [level.txt ...]\n"
+                            "       fuzz -r crash.txt\n");
+            return 2;
+        }
+        else
+        {
+            FuzzLevel lv;
+            lv.name = arg;
+            if(!loadLevel(&lv.start, arg))
+            {
+                fprintf(stderr, "Could not load %s\n", arg);
+                return 2;
+            }
+            lv.text = formatLevel(&lv.start);
+            findGoal(lv);
+            levels.push_back(lv);
+        }
+    }
+    if(levels.empty() && !opt.randomBoards)
+    {
+        static const int defaults[] = { 1, 2, 3, 4, 10 };
+        for(int lev : defaults)
+        {
+            FuzzLevel lv;
+            lv.name = levelPath(lev);
+            if(!loadLevel(&lv.start, lv.name.c_str()))
+                continue;
+            lv.text = formatLevel(&lv.start);
+            findGoal(lv);
+            levels.push_back(lv);
+        }
+        if(levels.empty())
+        {
+            fprintf(stderr, "No levels found, pass level files or -g\n");
+            return 2;
+        }
+    }
+    if(opt.threads < 1)
+        opt.threads = 1;
+
+    printf("fuzzing %d level(s)%s on %d thread(s), seed %llu\n", (int)levels.size(),
+           opt.randomBoards ? " plus random boards" : "", opt.threads, opt.seed);
+
+    auto begin = chrono::steady_clock::now();
+    vector<thread> pool;
+    for(int i=0; i<opt.threads; i++)
+        pool.push_back(thread(worker, i, &levels, &opt));
+    while(!stopAll)
+    {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+        if(opt.seconds > 0 && elapsed >= opt.seconds)
+            stopAll = 1;
+    }
+    for(auto &t : pool)
+        t.join();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    printf("%lld runs, %lld moves in %.2fs (%.2fM moves/s), %lld failure(s)\n",
+           runsDone.load(), stepsDone.load(), elapsed, stepsDone / elapsed / 1e6, failures.load());
+    return failures ? 1 : 0;
+}
@@ -1,7 +1,16 @@
 #include <iostream>
+#include <cstring>
 #include <cmath>
 #include <fstream>
 #include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <GL/glew.h>
 #include <GL/gl.h>
@@ -12,6 +21,22 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "rules.h"
+#include "scene.h"
+#include "editor.h"
+#include "particles.h"
+#include "spectate.h"
+#include "telemetry.h"
+#include "history.h"
+#include "savestate.h"
+#include "hud.h"
+#include "world.h"
+#include "capture.h"
+#include "statstore.h"
+#include "assets.h"
+#include "arena.h"
+#include "heatmap.h"
+
 using namespace std;
 
 struct VAO {
@@ -43,26 +68,14 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
     GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
     GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
-    // Read the Vertex Shader code from the file
-    std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-    if(VertexShaderStream.is_open())
-	{
-	    std::string Line = "";
-	    while(getline(VertexShaderStream, Line))
-		VertexShaderCode += "\n" + Line;
-	    VertexShaderStream.close();
-	}
-
-    // Read the Fragment Shader code from the file
-    std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    if(FragmentShaderStream.is_open()){
-	std::string Line = "";
-	while(getline(FragmentShaderStream, Line))
-	    FragmentShaderCode += "\n" + Line;
-	FragmentShaderStream.close();
-    }
+    // Read the shader code from the files, or the copies built in
+    int found;
+    std::string VertexShaderCode = assetText(vertex_file_path, &found);
+    if(!found)
+        fprintf(stderr, "Could not read %s\n", vertex_file_path);
+    std::string FragmentShaderCode = assetText(fragment_file_path, &found);
+    if(!found)
+        fprintf(stderr, "Could not read %s\n", fragment_file_path);
 
     GLint Result = GL_FALSE;
     int InfoLogLength;
@@ -118,8 +131,11 @@ static void error_callback(int error, const char* description)
     fprintf(stderr, "Error: %s\n", description);
 }
 
+extern GameState game;
+
 void quit(GLFWwindow *window)
 {
+    telemetryLog(EV_QUIT, &game);
     glfwDestroyWindow(window);
     glfwTerminate();
     exit(EXIT_SUCCESS);
@@ -136,10 +152,21 @@ void initGLEW(void){
 
 
 
+/* VAOs given back by deleteObject(), for the next create3DObject() to
+   take, so open world chunks coming and going don't churn the heap */
+vector<VAO*> spareVaos;
+
 /* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL, GLenum usage=GL_STATIC_DRAW)
 {
-    struct VAO* vao = new struct VAO;
+    struct VAO* vao;
+    if(spareVaos.empty())
+        vao = new struct VAO;
+    else
+    {
+        vao = spareVaos.back();
+        spareVaos.pop_back();
+    }
     vao->PrimitiveMode = primitive_mode;
     vao->NumVertices = numVertices;
     vao->FillMode = fill_mode;
@@ -152,7 +179,7 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
 
     glBindVertexArray (vao->VertexArrayID); // Bind the VAO
     glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, usage); // Copy the vertices into VBO
     glVertexAttribPointer(
                           0,                  // attribute 0. Vertices
                           3,                  // size (x,y,z)
@@ -163,7 +190,7 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
                           );
 
     glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
+    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, usage);  // Copy the vertex colors
     glVertexAttribPointer(
                           1,                  // attribute 1. Color
                           3,                  // size (r,g,b)
@@ -179,14 +206,14 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
 /* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
 struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
 {
-    GLfloat* color_buffer_data = new GLfloat [3*numVertices];
+    vector<GLfloat> color_buffer_data (3*numVertices);
     for (int i=0; i<numVertices; i++) {
         color_buffer_data [3*i] = red;
         color_buffer_data [3*i + 1] = green;
         color_buffer_data [3*i + 2] = blue;
     }
 
-    return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+    return create3DObject(primitive_mode, numVertices, vertex_buffer_data, &color_buffer_data[0], fill_mode);
 }
 
 /* Render the VBOs handled by VAO */
@@ -212,26 +239,47 @@ void draw3DObject (struct VAO* vao)
     glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
 }
 
+void deleteObject (struct VAO* vao)
+{
+    glDeleteBuffers(1, &vao->VertexBuffer);
+    glDeleteBuffers(1, &vao->ColorBuffer);
+    glDeleteVertexArrays(1, &vao->VertexArrayID);
+    spareVaos.push_back(vao);
+}
+
 /**************************
  * Customizable functions *
  **************************/
 
 double mouse1X =0, mouse1Y = 0,mouse2X =0, mouse2Y = 0;
-int currLevel = 2, moveRight = 0, moveUp = 0, numOfSteps=0;
+int currLevel = 2, moveRight = 0, moveUp = 0;
 int leftClick = 0, rightClick = 0;
-int lastMoveUp=0, lastMoveRight = 0;
-int level[10][20], currView= 3;
-float blockTransY, blockTransX;
+int currView= 3, splitScreen = 0;
 // bool triangle_rot_status = true;
-int endGame=0, win=0;
 double overTime= -10.0;
 float gameTime = 0, startTime;
 
-VAO *triangle, *Tile, *fragile, *blockVer, *blockAlongy, *blockAlongx, *horSwitch, *verSwitch;
-int currblock ;
-int checkH = 0, checkS = 0;
+VAO *triangle, *board, *cursor, *blockVer, *blockAlongy, *blockAlongx;
+GameState game;
+/* The board is one mesh with a fixed vertex range per row (see scene.h);
+   only the rows meshed again are uploaded, and only the part of each that
+   is drawn. Whatever changes a tile of game marks it there. */
+BoardMesh boardMesh;
+History history;      // of the level being played
+Arena levelArena;     // everything else kept about it, see startLevelData()
+World *world = NULL;  // open world mode (-world), see streamWorld()
+glm::vec3 worldOffset(0, 0, 0);   // of the chunk being played
 float r1 = 0.3f , g1 = 0.0f , b1 = 0.15f ;
 
+/* A level has just been put in game: what was kept about the last one
+   goes all at once and the new one's is taken from the same memory */
+void startLevelData()
+{
+    arenaReset(levelArena);
+    historyReset(history, &game, levelArena);
+    markBoardAll(boardMesh);
+}
+
 VAO *retCurrBlock(int value)
 {
   if(value==1)
@@ -242,6 +290,115 @@ VAO *retCurrBlock(int value)
 }
 
 void move_block();
+void stepHistory(int by);
+void requestScreenshot();
+void toggleRecording();
+void stepHeatmap();
+void advanceWorld();
+
+/* Level editor: 'e' toggles it, the arrow keys move the cursor, a tile key
+   (see EDITOR_TILES) selects a tile and places it under the cursor, the
+   left mouse button places the selected tile, the right one clears a cell,
+   a digit moves the switch or bridge under the cursor to that bridge group
+   and F2 saves the level back to its file */
+int editMode = 0, cursorRow = 4, cursorCol = 7;
+char editTile = 'o';
+int shownCheck = CHECK_PENDING - 1;
+glm::mat4 pickVP;
+
+void editCell(int row, int col, char key)
+{
+    if(!placeTile(&game, row, col, key))
+        return;
+    markBoardCell(boardMesh, row, col);
+    requestCheck(&game);
+    spectatePublish(&game);
+}
+
+void toggleEditMode(GLFWwindow *window)
+{
+    if(game.endGame || world)
+        return;
+    if(!editMode)
+    {
+        editMode = 1;
+        splitScreen = 0;
+        currView = 2;
+        cursorRow = blockRow(&game);
+        cursorCol = blockCol(&game);
+        shownCheck = CHECK_PENDING - 1;
+        startChecker();
+        requestCheck(&game);
+        return;
+    }
+    // Play resumes from the edited board, as if it had just been loaded
+    string text = formatLevel(&game);
+    if(!readLevel(&game, text.c_str()))
+    {
+        printf("The level needs a start tile (S)\n");
+        return;
+    }
+    editMode = 0;
+    startLevelData();
+    glfwSetWindowTitle(window, "Sample OpenGL 3.3 Application");
+    spectatePublish(&game);
+}
+
+void saveLevel()
+{
+    FILE *f = fopen(levelPath(currLevel), "w");
+    if(!f)
+    {
+        fprintf(stderr, "Could not write %s\n", levelPath(currLevel));
+        return;
+    }
+    fputs(formatLevel(&game).c_str(), f);
+    fclose(f);
+    printf("Saved %s\n", levelPath(currLevel));
+}
+
+/* The board cell under the mouse in the full-window view, if any */
+int pickCell(GLFWwindow *window, int &row, int &col)
+{
+    double mx, my;
+    int width, height;
+    glfwGetCursorPos(window, &mx, &my);
+    glfwGetWindowSize(window, &width, &height);
+    float nx = 2*mx/width - 1, ny = 1 - 2*my/height;
+
+    // Cast a ray through the pixel and meet it with the tile tops at z=0
+    glm::mat4 inv = glm::inverse(pickVP);
+    glm::vec4 nearP = inv * glm::vec4(nx, ny, -1, 1);
+    glm::vec4 farP = inv * glm::vec4(nx, ny, 1, 1);
+    nearP /= nearP.w;
+    farP /= farP.w;
+    if(nearP.z == farP.z)
+        return 0;
+    float t = nearP.z / (nearP.z - farP.z);
+    float x = nearP.x + t*(farP.x - nearP.x), y = nearP.y + t*(farP.y - nearP.y);
+    col = 7 - (int)floor(x);
+    row = 4 - (int)floor(y);
+    return row>=0 && row<LEVEL_ROWS && col>=0 && col<LEVEL_COLS;
+}
+
+/* Keep the window title in step with the tile and the last solver verdict */
+void showEditorStatus(GLFWwindow *window)
+{
+    int check = checkResult();
+    if(check == shownCheck)
+        return;
+    shownCheck = check;
+    char title[128];
+    if(check == CHECK_PENDING)
+        snprintf(title, sizeof(title), "Editor [%c] - checking...", editTile);
+    else if(check == CHECK_NO_START)
+        snprintf(title, sizeof(title), "Editor [%c] - no start tile", editTile);
+    else if(check == CHECK_UNSOLVABLE)
+        snprintf(title, sizeof(title), "Editor [%c] - unsolvable", editTile);
+    else
+        snprintf(title, sizeof(title), "Editor [%c] - solvable in %d moves", editTile, check);
+    glfwSetWindowTitle(window, title);
+}
 
 /* Executed when a regular key is pressed/released/held-down */
 /* Prefered for Keyboard events */
@@ -260,23 +417,46 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 	        case GLFW_KEY_ESCAPE:
 	            quit(window);
 	            break;
+          case GLFW_KEY_F2:
+              if(editMode)
+                  saveLevel();
+              break;
+          case GLFW_KEY_F11:
+              toggleRecording();
+              break;
+          case GLFW_KEY_F12:
+              requestScreenshot();
+              break;
+          default:
+              break;
+        }
+        if(editMode)
+        {
+            // The cursor moves the way the block would on the board
+            if(key==GLFW_KEY_LEFT && cursorCol<LEVEL_COLS-1)
+                cursorCol++;
+            else if(key==GLFW_KEY_RIGHT && cursorCol>0)
+                cursorCol--;
+            else if(key==GLFW_KEY_UP && cursorRow>0)
+                cursorRow--;
+            else if(key==GLFW_KEY_DOWN && cursorRow<LEVEL_ROWS-1)
+                cursorRow++;
+            return;
+        }
+        switch (key) {
           case GLFW_KEY_LEFT:
-              numOfSteps++;
               moveRight = -1;
               move_block();
               break;
           case GLFW_KEY_RIGHT:
-              numOfSteps++;
               moveRight = 1;
               move_block();
               break;
           case GLFW_KEY_UP:
-              numOfSteps++;
               moveUp = 1;
               move_block();
               break;
           case GLFW_KEY_DOWN:
-              numOfSteps++;
               moveUp = -1;
               move_block();
               break;
@@ -289,6 +469,23 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 /* Executed for character input (like in text boxes) */
 void keyboardChar (GLFWwindow* window, unsigned int key)
 {
+    if(editMode && key < 128 && strchr(EDITOR_TILES, key))
+    {
+        editTile = key;
+        shownCheck = CHECK_PENDING - 1;
+        editCell(cursorRow, cursorCol, key);
+        return;
+    }
+    if(editMode && key >= '0' && key < '0' + MAX_BRIDGE_GROUPS)
+    {
+        if(setGroup(&game, cursorRow, cursorCol, key - '0'))
+        {
+            markBoardCell(boardMesh, cursorRow, cursorCol);
+            requestCheck(&game);
+            spectatePublish(&game);
+        }
+        return;
+    }
     switch (key) {
     case 'Q':
     case 'q':
@@ -311,6 +508,23 @@ void keyboardChar (GLFWwindow* window, unsigned int key)
 	break;
     case 'b':
     currView= 5;
+    break;
+    case 'm':
+    if(!editMode)
+        splitScreen = 1 - splitScreen;
+    break;
+    case 'e':
+    toggleEditMode(window);
+    break;
+    case 'h':
+    stepHeatmap();
+    break;
+    case 'u':
+    stepHistory(-1);
+    break;
+    case 'r':
+    stepHistory(1);
+    break;
     default:
 	break;
     }
@@ -319,6 +533,17 @@ void keyboardChar (GLFWwindow* window, unsigned int key)
 /* Executed when a mouse button is pressed/released */
 void mouseButton (GLFWwindow* window, int button, int action, int mods)
 {
+    int row, col;
+    if(editMode)
+    {
+        if(action == GLFW_PRESS && pickCell(window, row, col))
+        {
+            cursorRow = row;
+            cursorCol = col;
+            editCell(row, col, button == GLFW_MOUSE_BUTTON_RIGHT ? '-' : editTile);
+        }
+        return;
+    }
     switch (button) {
     case GLFW_MOUSE_BUTTON_LEFT:
 	if (action == GLFW_PRESS)
@@ -338,6 +563,13 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
 }
 
 
+/* Executed when the mouse wheel turns: scrubs through the undo history */
+void scrollWheel (GLFWwindow* window, double xoffset, double yoffset)
+{
+    if(yoffset)
+        stepHistory(yoffset > 0 ? -1 : 1);
+}
+
 /* Executed when window is resized to 'width' and 'height' */
 /* Modify the bounds of the screen here in glm::ortho or Field of View in glm::Perspective */
 void reshapeWindow (GLFWwindow* window, int width, int height)
@@ -359,116 +591,6 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
 }
 
 
-void createTile(int col)
-{
-    // GL3 accepts only Triangles. Quads are not supported
-    GLfloat vertex_buffer_data [] = {
-	0, 0, 0, // vertex 1
-	0.95, 0, 0, // vertex 2
-	0.95, 0.95, 0, // vertex 3
-
-	0, 0, 0, // vertex 0.95
-	0.95, 0.95, 0, // vertex 3
-  0, 0.95, 0,  // vertex 4
-
-  0, 0, -0.2,
-  0.95, 0, -0.2,
-  0.95, 0.95, -0.2,
-
-  0, 0, -0.2,
-  0.95, 0.95, -0.2,
-  0, 0.95, -0.2,
-
-  0, 0, 0,
-  0, 0 ,-0.2,
-  0.95, 0 , 0,
-
-  0.95, 0, 0,
-  0.95, 0, -0.2,
-  0, 0, -0.2,
-
-  0.95, 0, 0,
-  0.95, 0, -0.2,
-  0.95, 0.95, -0.2,
-
-  0.95, 0.95, -0.2,
-  0.95, 0.95, 0,
-  0.95, 0, 0,
-
-  0.95, 0.95, 0,
-  0.95, 0.95, -0.2,
-  0, 0.95, 0,
-
-  0, 0.95, 0,
-  0, 0.95, -0.2,
-  0.95, 0.95, -0.2,
-
-  0, 0, 0,
-  0, 0, -0.2,
-  0, 0.95, 0,
-
-  0, 0.95, 0,
-  0, 0.95, -0.2,
-  0, 0, -0.2
-    };
-
-    GLfloat color_buffer_data [] = {
-	0.5,0.25*col,0, // color 1
-	0.5,0.25*col,0, // color 2
-	0.5,0.25*col,0, // color 3
-
-  0.5,0.25*col,0, // color 1
-	0.5,0.25*col,0, // color 2
-	0.5,0.25*col,0,   // color 4
-
-  0.5,0.25*col,0, // color 1
-  0.5,0.25*col,0, // color 2
-  0.5,0.25*col,0,
-
-  0.5,0.25*col,0, // color 1
-  0.5,0.25*col,0, // color 2
-  0.5,0.25*col,0,
-
-  0,0,0,
-  0,0,0,
-  0,0,0,
-
-  0,0,0,
-  0,0,0,
-  0,0,0,
-
-  0,0,0,
-  0,0,0,
-  0,0,0,
-
-  0,0,0,
-  0,0,0,
-  0,0,0,
-
-  0,0,0,
-  0,0,0,
-  0,0,0,
-
-  0,0,0,
-  0,0,0,
-  0,0,0,
-
-  0,0,0,
-  0,0,0,
-  0,0,0,
-
-  0,0,0,
-  0,0,0,
-  0,0,0,
-    };
-
-    // create3DObject creates and returns a handle to a VAO that can be used later
-    if(col==1)
-      Tile = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
-    else
-      fragile = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
-}
-
 void createBlock_Alongy()
 {
   GLfloat vertex_buffer_data[]={
@@ -789,276 +911,1082 @@ void createBlock_Ver()
   blockVer = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
 }
 
-void createVerSwitch()
+/* The editor cursor: a yellow square over the whole cell, just above the
+   tile tops */
+void createCursor()
 {
     GLfloat vertex_buffer_data[]={
-      0.25,0.25,0.1,
-      0.25,0.75,0.1,
-      0.75,0.75,0.1,
+      0,0,0.05,
+      1,0,0.05,
+      1,1,0.05,
 
-      0.25,0.25,0.1,
-      0.75,0.25,0.1,
-      0.75,0.75,0.1
+      0,0,0.05,
+      1,1,0.05,
+      0,1,0.05
     };
 
-    GLfloat color_buffer_data[]={
-      0.0, 0.0, 0,
-      0.0, 0.0, 0,
-      0.0, 0.0, 0,
+    cursor = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, 1, 1, 0, GL_FILL);
+}
 
-      0.0, 0.0, 0,
-      0.0, 0.0, 0,
-      0.0, 0.0, 0
-    };
+float camera_rotation_angle = 90.0;
 
-    verSwitch = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+/* Print the result once, when the rules first end the game */
+void reportGameOver()
+{
+    if(game.endGame == 1 && overTime<0)
+    {
+        if(game.win==1)
+        {
+          printf("CONGRATULATIONS YOU WON!\n");
+          saveClear();
+        }
+        else
+          printf("BETTER LUCK NEXT TIME :( (u undoes the last move)\n");
+        printf("Number Of Steps Taken: %d\n",game.numOfSteps);
+        printf("Time Taken: %lf\n",gameTime);
+        // Open world chunks aren't numbered levels
+        if(!world && !editMode)
+            statsRecord(currLevel, game.win, game.numOfSteps, gameTime);
+        overTime = glfwGetTime();
+    }
 }
 
-void createHorSwitch()
-{
-    // printf("x : %lf\ny : %lf\n",xshift,yshift);
-    GLfloat vertex_buffer_data[]={
-      0.25,0.25,0.1,
-      0.5,0.5,0.1,
-      0.75,0.25,0.1
-    };
+/* Debris from a fall: the pool size is set with -particles, and each fall
+   throws half of it out of every cell the block covered */
+Particles debris;
+int debrisCount = 20000;
+VAO *debrisChip;
+GLuint debrisBuffers[3];
 
-    GLfloat color_buffer_data[]={
-        0.0, 0.0, 0,
-        0.0, 0.0, 0,
-        0.0, 0.0, 0
-    };
+void createDebris()
+{
+    // A cube 0.08 on a side, in the orange of the tile tops
+    static const int corners[36] = { 0,1,3, 0,3,2, 4,7,5, 4,6,7, 0,4,5, 0,5,1,
+                                     2,3,7, 2,7,6, 0,2,6, 0,6,4, 1,5,7, 1,7,3 };
+    GLfloat vertex_buffer_data[36*3], color_buffer_data[36*3];
+    for(int v=0; v<36; v++)
+    {
+        vertex_buffer_data[3*v] = (corners[v] & 4) ? 0.08 : 0;
+        vertex_buffer_data[3*v+1] = (corners[v] & 2) ? 0.08 : 0;
+        vertex_buffer_data[3*v+2] = (corners[v] & 1) ? 0.08 : 0;
+        color_buffer_data[3*v] = 0.5;
+        color_buffer_data[3*v+1] = 0.25;
+        color_buffer_data[3*v+2] = 0;
+    }
+    debrisChip = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
 
-    horSwitch = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_FILL);
+    // One per-instance buffer per coordinate, straight from the particle arrays
+    initParticles(debris, debrisCount);
+    glBindVertexArray (debrisChip->VertexArrayID);
+    glGenBuffers (3, debrisBuffers);
+    for(int k=0; k<3; k++)
+    {
+        glBindBuffer (GL_ARRAY_BUFFER, debrisBuffers[k]);
+        glBufferData (GL_ARRAY_BUFFER, debrisCount*sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+        glVertexAttribPointer(2+k, 1, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        glVertexAttribDivisor(2+k, 1);
+        glEnableVertexAttribArray(2+k);
+    }
 }
 
-float camera_rotation_angle = 90.0;
+void updateDebris(float dt)
+{
+    if(!debris.count)
+        return;
+    updateParticles(debris, dt);
+    const vector<float> *coords[3] = { &debris.x, &debris.y, &debris.z };
+    for(int k=0; k<3 && debris.count; k++)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, debrisBuffers[k]);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, debris.count*sizeof(GLfloat), &(*coords[k])[0]);
+    }
+}
 
-void checkSwitch()
+void drawDebris()
 {
-  int blockx = 7 - blockTransX ;
-  int blocky = 4 - blockTransY ;
+    if(!debris.count)
+        return;
+    glBindVertexArray (debrisChip->VertexArrayID);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, debrisChip->NumVertices, debris.count);
+}
 
-  if(level[blocky][blockx]==5 && currblock==1)
-    checkH = 1 - checkH ;
-  else if(currblock==2)
-  {
-    if(level[blocky][blockx]==6 || level[blocky-1][blockx]==6)
-      checkS = 1 - checkS ;
-  }
-  else if(currblock==3)
-  {
-    if(level[blocky][blockx]==6 || level[blocky][blockx-1]==6)
-      checkS = 1 - checkS ;
-  }
-  return ;
+/* The block went over the edge, or through a fragile tile */
+void shatter()
+{
+    float x = game.blockTransX + worldOffset.x, y = game.blockTransY + worldOffset.y;
+    emitParticles(debris, x, y, 0, debrisCount/2);
+    if(game.currblock == B_ALONGY)
+        emitParticles(debris, x, y+1, 0, debrisCount/2);
+    else if(game.currblock == B_ALONGX)
+        emitParticles(debris, x+1, y, 0, debrisCount/2);
 }
 
-void checkGameOver()
+/* Telemetry for one move, worked out from what it changed */
+void logMove(const GameState *before)
 {
-    int blockx = 7 - blockTransX ;
-    int blocky = 4 - blockTransY ;
+    if(before->endGame)
+        return;
+    telemetryLog(EV_MOVE, &game, moveUp ? (moveUp > 0 ? 'U' : 'D') : (moveRight > 0 ? 'R' : 'L'));
+    if(before->bridges != game.bridges)
+        telemetryLog(EV_SWITCH, &game, game.bridges);
+    int row = blockRow(&game), col = blockCol(&game);
+    if(tileAt(before, row, col) == T_FRAGILE && tileAt(&game, row, col) == T_EMPTY)
+        telemetryLog(EV_FRAGILE, &game);
+    if(game.win)
+        telemetryLog(EV_WIN, &game);
+    else if(game.endGame)
+        telemetryLog(EV_FALL, &game);
+}
 
-    if(level[blocky][blockx]==0 || blockx >= 20 || blockx < 0 || blocky >=10 || blocky<0)
-      endGame = 1;
-    if(level[blocky][blockx]==7 && checkH == 0)
-      endGame = 1;
-    if(level[blocky][blockx]==8 && checkS == 0)
-      endGame = 1;
-    else if(currblock == 1)
-    {
-      if(level[blocky][blockx]==3)
-      {
-        endGame = 1;
-        win = 1;
-      }
-      else if(level[blocky][blockx]==4)
-      {
-        endGame = 1;
-        level[blocky][blockx]=0;
-      }
-    }
-    else if(currblock == 2)
-    {
-        if(level[blocky-1][blockx]==0)
-          endGame = 1;
-        if(level[blocky-1][blockx]==7 && checkH==0)
-          endGame = 1;
-        if(level[blocky-1][blockx]==8 && checkS==0)
-          endGame = 1;
-        else if(blocky < 0)
-          endGame = 1;
-    }
-    else
-    {
-      if(level[blocky][blockx-1]==0)
-        endGame = 1;
-      if(level[blocky][blockx-1]==7 && checkH==0)
-        endGame = 1;
-      if(level[blocky][blockx-1]==8 && checkS==0)
-        endGame = 1;
-      else if(blockx < 0)
-        endGame = 1;
-    }
-    if(endGame == 1 && overTime<0)
+/* Undo (by < 0) or redo a move; 'u' and 'r' repeat while held and the
+   mouse wheel scrubs through the history the same way */
+void stepHistory(int by)
+{
+    int steps = game.numOfSteps;
+    // Undoing a fall mends the tile the block broke, where it stood
+    markBlockCells(boardMesh, &game);
+    if(editMode || !(by < 0 ? historyUndo(history, &game) : historyRedo(history, &game)))
+        return;
+    markBlockCells(boardMesh, &game);
+    // Back out of a fall: the block is on the board again
+    if(!game.endGame)
     {
-        if(win==1)
-          printf("CONGRATULATIONS YOU WON!\n");
-        else
-          printf("BETTER LUCK NEXT TIME :(\n");
-        printf("Number Of Steps Taken: %d\n",numOfSteps);
-        printf("Time Taken: %lf\n",gameTime);
-        overTime = glfwGetTime();
+        overTime = -10.0;
+        debris.count = 0;
     }
+    telemetryLog(EV_REWIND, &game, min(steps, 0xffff));
+    spectatePublish(&game);
+    reportGameOver();
+}
+
+/* The session is saved whenever it changes, and every few seconds for
+   the play time, so a restart picks it up again (see main). Positions
+   after a fall aren't saved: the save keeps the one before it. */
+const char *savePath = "bloxorz.sav";
+
+void autosave()
+{
+    static GameState saved;
+    static SaveExtras savedExtras;
+    static double savedAt = -100;
+    if(editMode || game.endGame || world)
+        return;
+    SaveExtras extras = { currLevel, gameTime, currView, splitScreen, camera_rotation_angle };
+    double now = glfwGetTime();
+    if(now - savedAt < 5 && !memcmp(&saved, &game, sizeof(game)) && extras.level == savedExtras.level
+       && extras.view == savedExtras.view && extras.splitScreen == savedExtras.splitScreen
+       && extras.cameraAngle == savedExtras.cameraAngle)
+        return;
+    savePublish(&game, &extras);
+    saved = game;
+    savedExtras = extras;
+    savedAt = now;
 }
 
 void move_block()
 {
-    if(moveUp!=0)
-    {
-        if(currblock == 1)
-        {
-          blockTransY += moveUp - (1-moveUp)/2 ;
-          currblock = 2;
-        }
-        else if(currblock == 2)
-        {
-            blockTransY += moveUp + (1+moveUp)/2 ;
-            currblock = 1;
-        }
-        else
-        {
-          blockTransY += moveUp ;
-        }
-        lastMoveUp = moveUp;
-        moveUp = 0;
-    }
-    else if(moveRight!=0)
-    {
-        if(currblock == 1)
-        {
-          blockTransX += moveRight - (1-moveRight)/2;
-          currblock = 3;
-        }
-        else if(currblock == 3)
-        {
-          blockTransX += moveRight + (1+moveRight)/2 ;
-          currblock = 1;
-        }
-        else
-        {
-          blockTransX += moveRight ;
-        }
-        lastMoveRight = moveRight;
-        moveRight =0;
-    }
-    checkGameOver();
-    checkSwitch();
+    GameState before = game;
+    moveBlock(&game, moveUp, moveRight);
+    markBlockCells(boardMesh, &game);
+    logMove(&before);
+    if(!before.endGame)
+        historyRecord(history, &game);
+    if(!before.endGame && game.endGame && !game.win)
+        shatter();
+    if(!before.endGame && game.win && world)
+        advanceWorld();
+    spectatePublish(&game);
+    moveUp = 0;
+    moveRight = 0;
+    reportGameOver();
     return ;
 }
 
-/* Render the scene with openGL */
-/* Edit this function according to your assignment */
-void draw (GLFWwindow* window, float x, float y, float w, float h)
+/* Camera for one of the five views (see keyboardChar) */
+void cameraFor(int view, glm::vec3 &eye, glm::vec3 &target, glm::vec3 &up)
 {
-    int fbwidth, fbheight;
-    glfwGetFramebufferSize(window, &fbwidth, &fbheight);
-    glViewport((int)(x*fbwidth), (int)(y*fbheight), (int)(w*fbwidth), (int)(h*fbheight));
-    // use the loaded shader program
-    // Don't change unless you know what you are doing
-    glUseProgram(programID);
-
-    glm::vec3 eye,up,target;
     // Eye - Location of camera. Don't change unless you are sure!!
-    if(currView-1==0)
+    if(view-1==0)
     {
-        if(currblock-2==0)
+        if(game.currblock-2==0)
         {
             up = glm::vec3(0,0,1);
-            if(lastMoveUp-1>=0)
-                eye = glm::vec3(blockTransX, blockTransY+1,0.5);
+            if(game.lastMoveUp-1>=0)
+                eye = glm::vec3(game.blockTransX, game.blockTransY+1,0.5);
             else
-                eye = glm::vec3(blockTransX, blockTransY,0.5);
+                eye = glm::vec3(game.blockTransX, game.blockTransY,0.5);
             target = glm::vec3(-2000,0,0);
         }
-        else if(currblock-1==0)
+        else if(game.currblock-1==0)
         {
             up = glm::vec3(0,0,1);
             if(!currLevel);
             else
             {
-                eye = glm::vec3(blockTransX, blockTransY+0.5, 0.5);
+                eye = glm::vec3(game.blockTransX, game.blockTransY+0.5, 0.5);
                 target = glm::vec3(-2000,0,0);
             }
         }
-        else if(currblock-3==0)
+        else if(game.currblock-3==0)
         {
             up = glm::vec3(0,0,1);
-                if(lastMoveRight-1 == 0)
-                    eye = glm::vec3(blockTransX, blockTransY+0.5, 0.5);
+                if(game.lastMoveRight-1 == 0)
+                    eye = glm::vec3(game.blockTransX, game.blockTransY+0.5, 0.5);
                 else
-                    eye = glm::vec3(blockTransX-1, blockTransY+0.5,0.5);
+                    eye = glm::vec3(game.blockTransX-1, game.blockTransY+0.5,0.5);
                 target = glm::vec3(-2000,0,0);
         }
     }
-    else if(currView-2==0)
+    else if(view-2==0)
     {
         eye  = glm::vec3(0,0,10);
         up = glm::vec3(0,1,0);
         target = glm::vec3(0,0,0);
     }
-    else if(currView-3==0)
+    else if(view-3==0)
     {
         eye= glm::vec3( 0, -7, 7 );
         up= glm::vec3(0, 1, 0);
         target = glm::vec3(0,0,0);
     }
-    else if(currView-4==0)
+    else if(view-4==0)
     {
-        if(currblock-1 == 0)
+        if(game.currblock-1 == 0)
         {
             up = glm::vec3(0,0,1);
             if(!currLevel);
-            eye = glm::vec3(blockTransX+5, blockTransY+0.5, 4);
+            eye = glm::vec3(game.blockTransX+5, game.blockTransY+0.5, 4);
             target = glm::vec3(-2000,0,0);
         }
-        else if(currblock-2 == 0)
+        else if(game.currblock-2 == 0)
         {
             up = glm::vec3(0,0,1);
             if(!currLevel);
-            if(lastMoveUp==1)
-                eye = glm::vec3(blockTransX+5, blockTransY+1,4);
+            if(game.lastMoveUp==1)
+                eye = glm::vec3(game.blockTransX+5, game.blockTransY+1,4);
             else
-                eye = glm::vec3(blockTransX+5, blockTransY,4);
+                eye = glm::vec3(game.blockTransX+5, game.blockTransY,4);
             target = glm::vec3(-2000,0,0);
 
         }
-        else if(currblock-3 == 0)
+        else if(game.currblock-3 == 0)
         {
             up = glm::vec3(0,0,1);
-            if(lastMoveRight -1== 0)
-                eye = glm::vec3(blockTransX+5, blockTransY+0.5, 4);
+            if(game.lastMoveRight -1== 0)
+                eye = glm::vec3(game.blockTransX+5, game.blockTransY+0.5, 4);
             else
-                eye = glm::vec3(blockTransX+4, blockTransY+0.5,4);
+                eye = glm::vec3(game.blockTransX+4, game.blockTransY+0.5,4);
             target = glm::vec3(-2000,0,0);
         }
     }
-    else if(currView-5==0)
+    else if(view-5==0)
+    {
+        eye = glm::vec3(7*cos(camera_rotation_angle*M_PI/180.0), -7*sin(camera_rotation_angle*M_PI/180.0), 7);
+        target = glm::vec3(0,0,0);
+        up = glm::vec3(-1*cos(camera_rotation_angle*M_PI/180.0),sin(camera_rotation_angle*M_PI/180.0),0);
+    }
+
+}
+
+void createBoard()
+{
+    initBoardMesh(boardMesh);
+    board = create3DObject(GL_TRIANGLES, BOARD_VERTS, &boardMesh.pos[0], &boardMesh.color[0], GL_FILL, GL_DYNAMIC_DRAW);
+}
+
+/* Returns whether any row changed */
+int updateBoard()
+{
+    static vector<int> changed;
+    syncBoardMesh(&game, boardMesh, changed);
+    // Upload runs of neighbouring rows with one call each
+    for(size_t k=0; k<changed.size(); )
+    {
+        size_t run = k+1;
+        while(run<changed.size() && changed[run]==changed[run-1]+1)
+            run++;
+        int last = changed[run-1];
+        GLintptr offset = 3*changed[k]*ROW_VERTS*sizeof(GLfloat);
+        GLsizeiptr size = 3*((last-changed[k])*ROW_VERTS + boardMesh.rowVerts[last])*sizeof(GLfloat);
+        glBindBuffer(GL_ARRAY_BUFFER, board->VertexBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, &boardMesh.pos[3*changed[k]*ROW_VERTS]);
+        glBindBuffer(GL_ARRAY_BUFFER, board->ColorBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, &boardMesh.color[3*changed[k]*ROW_VERTS]);
+        k = run;
+    }
+    return !changed.empty();
+}
+
+/* Draw a board mesh's rows, skipping the unused end of each */
+void drawBoard(VAO *vao, const int *rowVerts)
+{
+    static GLint first[LEVEL_ROWS];
+    for(int i=0; i<LEVEL_ROWS; i++)
+        first[i] = i*ROW_VERTS;
+    glPolygonMode(GL_FRONT_AND_BACK, vao->FillMode);
+    glBindVertexArray(vao->VertexArrayID);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glMultiDrawArrays(vao->PrimitiveMode, first, rowVerts, LEVEL_ROWS);
+}
+
+/* Heatmap overlay (-heatmap file, see heatmap.h): on the level the
+   heatmap was made for, each tile is tinted by how many times players
+   visited it, fell off it or broke it, on a log scale from blue through
+   yellow to red; 'h' steps through the three and off. The tints are a
+   quad just above each tile that is showing, blended over the board, and
+   are meshed again whenever the board is. */
+Heatmap heat;
+int heatKind = -1;          // the counts shown, -1 for none
+int heatVerts = 0, heatDirty = 0;
+VAO *heatOverlay;
+
+/* Is the overlay to be drawn on the level being played? */
+int heatShown()
+{
+    return heatKind >= 0 && !world && !editMode && heat.level == levelPath(currLevel);
+}
+
+void createHeatOverlay()
+{
+    static vector<GLfloat> zeros(3*6*LEVEL_ROWS*LEVEL_COLS);
+    heatOverlay = create3DObject(GL_TRIANGLES, 6*LEVEL_ROWS*LEVEL_COLS, &zeros[0], &zeros[0], GL_FILL, GL_DYNAMIC_DRAW);
+}
+
+/* Blue, green, yellow, red for t from 0 to 1 */
+void heatColor(float t, GLfloat *rgb)
+{
+    static const float stops[4][3] = { {0.1, 0.2, 0.9}, {0.1, 0.8, 0.2}, {0.95, 0.9, 0.1}, {0.9, 0.1, 0.05} };
+    float at = min(max(t, 0.0f), 1.0f) * 3;
+    int k = min((int)at, 2);
+    for(int c=0; c<3; c++)
+        rgb[c] = stops[k][c] + (at-k)*(stops[k+1][c] - stops[k][c]);
+}
+
+void updateHeatOverlay()
+{
+    static GLfloat pos[3*6*LEVEL_ROWS*LEVEL_COLS], color[3*6*LEVEL_ROWS*LEVEL_COLS];
+    heatDirty = 0;
+    heatVerts = 0;
+    if(heatKind < 0)
+        return;
+    long long most = 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            most = max(most, heat.count[heatKind][i][j]);
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+        {
+            long long n = heat.count[heatKind][i][j];
+            if(!n || boardMesh.look[i][j] == LOOK_NONE)
+                continue;
+            GLfloat rgb[3];
+            heatColor(log(1.0 + n) / log(1.0 + most), rgb);
+            // Under the editor cursor and the switch markers
+            static const float corner[6][2] = { {0,0}, {1,0}, {1,1}, {0,0}, {1,1}, {0,1} };
+            for(int v=0; v<6; v++, heatVerts++)
+            {
+                pos[3*heatVerts] = 7-j + corner[v][0];
+                pos[3*heatVerts+1] = 4-i + corner[v][1];
+                pos[3*heatVerts+2] = 0.03;
+                for(int c=0; c<3; c++)
+                    color[3*heatVerts+c] = rgb[c];
+            }
+        }
+    glBindBuffer(GL_ARRAY_BUFFER, heatOverlay->VertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, 3*heatVerts*sizeof(GLfloat), pos);
+    glBindBuffer(GL_ARRAY_BUFFER, heatOverlay->ColorBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, 3*heatVerts*sizeof(GLfloat), color);
+}
+
+/* 'h': visits, falls, breaks, off and round again */
+void stepHeatmap()
+{
+    if(heat.level.empty())
+        return;
+    heatKind = heatKind+1 < HEAT_KINDS ? heatKind+1 : -1;
+    heatDirty = 1;
+    if(heatKind < 0)
+        printf("Heatmap off\n");
+    else
+        printf("Heatmap of %s over %lld plays\n", heatName(heatKind), heat.plays);
+}
+
+void drawHeatOverlay()
+{
+    if(!heatShown() || !heatVerts)
+        return;
+    glEnable(GL_BLEND);
+    glBlendColor(0, 0, 0, 0.6);
+    glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+    heatOverlay->NumVertices = heatVerts;
+    draw3DObject(heatOverlay);
+    glDisable(GL_BLEND);
+}
+
+/* Open world mode (-world file, see world.h). game is always the chunk
+   being played, drawn with the live board mesh at worldOffset; the other
+   chunks the world keeps loaded are drawn from static meshes. Those are
+   uploaded at most one a frame and freed as the world drops them, so
+   neither memory nor the time spent on loads grows with the world. A
+   chunk is handed back to the world once its mesh is uploaded, and its
+   buffers are loaded into again. */
+struct ChunkModel {
+    int index;
+    LoadedChunk *chunk;   // until uploaded
+    VAO *vao;             // NULL until uploaded
+    GameState start;
+    int rowVerts[LEVEL_ROWS];
+};
+vector<ChunkModel> chunkModels;
+int worldIndex = 0;       // the chunk being played
+int waitingChunk = 0;     // won, and the next chunk isn't loaded yet
+
+/* The model of chunk index, or NULL when it isn't loaded */
+ChunkModel *findChunk(int index)
+{
+    for(ChunkModel &m : chunkModels)
+        if(m.index == index)
+            return &m;
+    return NULL;
+}
+
+glm::vec3 chunkOffset(int index)
+{
+    const WorldChunk &c = worldChunk(world, index);
+    return glm::vec3(-c.x*LEVEL_COLS, -c.y*LEVEL_ROWS, 0);
+}
+
+/* The chunk to play after index, skipping ones that failed to load; -1
+   after the last */
+int nextChunk(int index)
+{
+    for(int k=index+1; k<worldChunkCount(world); k++)
+        if(!worldChunkFailed(world, k))
+            return k;
+    return -1;
+}
+
+void enterChunk(int index)
+{
+    game = findChunk(index)->start;
+    worldIndex = index;
+    worldOffset = chunkOffset(index);
+    waitingChunk = 0;
+    overTime = -10.0;
+    startLevelData();
+    telemetryLog(EV_LEVEL_START, &game, index);
+    spectatePublish(&game);
+}
+
+/* A chunk was won: play carries on in the next one as soon as it is
+   loaded. Winning the last one ends the game as usual. */
+void advanceWorld()
+{
+    if(nextChunk(worldIndex) >= 0)
+        waitingChunk = 1;
+}
+
+/* Load and drop chunks around the block; returns whether anything on
+   screen changed */
+int streamWorld()
+{
+    if(!world)
+        return 0;
+    static vector<LoadedChunk*> loaded;
+    static vector<int> evicted;
+    loaded.clear();
+    evicted.clear();
+    const WorldChunk &c = worldChunk(world, worldIndex);
+    int next = nextChunk(worldIndex);
+    worldUpdate(world, c.y*LEVEL_ROWS + blockRow(&game), c.x*LEVEL_COLS + blockCol(&game), next, loaded, evicted);
+
+    int changed = !evicted.empty();
+    for(LoadedChunk *chunk : loaded)
+    {
+        chunkModels.push_back(ChunkModel());
+        ChunkModel &m = chunkModels.back();
+        m.index = chunk->index;
+        m.chunk = chunk;
+        m.vao = NULL;
+        m.start = chunk->start;
+        memcpy(m.rowVerts, chunk->mesh.rowVerts, sizeof(m.rowVerts));
+    }
+    for(int index : evicted)
+    {
+        ChunkModel *m = findChunk(index);
+        if(m->vao)
+            deleteObject(m->vao);
+        if(m->chunk)
+            worldRecycle(world, m->chunk);
+        *m = chunkModels.back();
+        chunkModels.pop_back();
+    }
+    for(ChunkModel &m : chunkModels)
+        if(!m.vao)
+        {
+            // The GPU has its own copy from now on
+            BoardMesh &mesh = m.chunk->mesh;
+            m.vao = create3DObject(GL_TRIANGLES, BOARD_VERTS, &mesh.pos[0], &mesh.color[0]);
+            worldRecycle(world, m.chunk);
+            m.chunk = NULL;
+            changed = 1;
+            break;
+        }
+
+    if(waitingChunk && next >= 0 && findChunk(next))
+    {
+        enterChunk(next);
+        changed = 1;
+    }
+    return changed;
+}
+
+/* Wait for the first chunk that loads and start there */
+void startWorld()
+{
+    for(worldIndex = 0; worldIndex < worldChunkCount(world); worldIndex++)
+    {
+        while(!findChunk(worldIndex) && !worldChunkFailed(world, worldIndex))
+        {
+            streamWorld();
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        if(findChunk(worldIndex))
+        {
+            enterChunk(worldIndex);
+            return;
+        }
+    }
+    fprintf(stderr, "None of the levels in the world could be loaded\n");
+    exit(EXIT_FAILURE);
+}
+
+void stopWorld()
+{
+    WorldStats stats = worldStats(world);
+    printf("World: %lld chunk loads, %lld evictions, at most %d chunks resident\n",
+           stats.loads, stats.evictions, stats.maxResident);
+    closeWorld(world);
+}
+
+/* Work shared by every viewport, done once per frame: the block's model
+   matrix, the helicopter camera and the board mesh */
+glm::mat4 blockModel;
+
+void prepareFrame()
+{
+    if(currView==5 || splitScreen)
     {
         if(leftClick-1==0)
             camera_rotation_angle=camera_rotation_angle + 1;
         if(rightClick-1 == 0)
             camera_rotation_angle=camera_rotation_angle- 1;
-        eye = glm::vec3(7*cos(camera_rotation_angle*M_PI/180.0), -7*sin(camera_rotation_angle*M_PI/180.0), 7);
-        target = glm::vec3(0,0,0);
-        up = glm::vec3(-1*cos(camera_rotation_angle*M_PI/180.0),sin(camera_rotation_angle*M_PI/180.0),0);
     }
 
+    blockModel = glm::mat4(1.0f);
+    if(game.endGame-1==0)
+    {
+        double currTime = glfwGetTime();
+        // A win ends the game; after a fall the block stays out of sight
+        // until a move is undone
+        double fallen = min(currTime - overTime, 2.0);
+        glm::mat4 translateBlock = glm::translate (worldOffset + glm::vec3(game.blockTransX, game.blockTransY, 0 - 5*fallen));        // glTranslatef
+        blockModel *= (translateBlock);
+        if(game.win && !waitingChunk && currTime - overTime > 2.0)
+            exit(0);
+    }
+    else
+    {
+        glm::mat4 translateBlock = glm::translate (worldOffset + glm::vec3(game.blockTransX, game.blockTransY, 0));        // glTranslatef
+        // glm::mat4 rotateBlock = glm::rotate(blockRotAngle, blockRotAxis); // rotate about vector (-1,1,1)
+        blockModel *= (translateBlock);
+    }
+
+    if(updateBoard() || heatDirty)
+        updateHeatOverlay();
+
+    // Frames can be far apart when drawing on demand
+    static double lastFrame = glfwGetTime();
+    double now = glfwGetTime();
+    updateDebris(min(now - lastFrame, 0.1));
+    lastFrame = now;
+}
+
+/* Dynamic resolution: the scene is drawn into an offscreen framebuffer
+   renderScale times the window's size and scaled up to the window, with
+   the HUD drawn on top at full size. The time the GPU spends on each
+   frame comes back through a ring of timer queries, read only once
+   they're ready, and a feedback controller steers renderScale so a frame
+   fits in frameBudget. Fill rate goes with the number of pixels, so the
+   scale moves by the square root of budget over time. The controller
+   works on a smooth targetScale, and renderScale only follows it in steps
+   of 1/SCALE_STEPS once it's most of a step away, so the framebuffer
+   isn't reallocated every frame or flipped between two sizes, and at full
+   scale the scene is drawn straight to the window.
+   -budget ms sets the budget and -scale f fixes the scale instead. */
+#define SCALE_MIN 0.4
+#define SCALE_STEPS 20
+#define FRAME_QUERIES 4
+
+float renderScale = 1, targetScale = 1, fixedScale = 0, lowestScale = 1;
+double frameBudget = 1.0/60, smoothedFrame = 0;
+GLuint sceneFbo, sceneColor, sceneDepth;
+int sceneWidth = 0, sceneHeight = 0;        // what the scene is drawn at
+int allocatedWidth = 0, allocatedHeight = 0;
+GLuint frameQueries[FRAME_QUERIES];
+int queryBusy[FRAME_QUERIES], queryNext = 0, timing = 0;
+float queryScale[FRAME_QUERIES];            // the scale each timed frame was drawn at
+
+void createSceneTarget()
+{
+    glGenFramebuffers(1, &sceneFbo);
+    glGenRenderbuffers(1, &sceneColor);
+    glGenRenderbuffers(1, &sceneDepth);
+    glGenQueries(FRAME_QUERIES, frameQueries);
+    memset(queryBusy, 0, sizeof(queryBusy));
+    if(fixedScale)
+        renderScale = targetScale = lowestScale = fixedScale;
+}
+
+/* Steer the scale from one frame's GPU time */
+void steerScale(double seconds)
+{
+    smoothedFrame = smoothedFrame ? 0.8*smoothedFrame + 0.2*seconds : seconds;
+    if(fixedScale || smoothedFrame <= 0)
+        return;
+    // Aim a little under the budget, and only move part of the way there
+    // each frame so one slow frame doesn't throw the scale about
+    double want = targetScale * sqrt(0.9*frameBudget / smoothedFrame);
+    targetScale = max((double)SCALE_MIN, min(1.0, targetScale + 0.3*(want - targetScale)));
+    if(fabs(targetScale - renderScale) > 0.75 / SCALE_STEPS)
+    {
+        renderScale = round(targetScale * SCALE_STEPS) / SCALE_STEPS;
+        lowestScale = min(lowestScale, renderScale);
+        smoothedFrame = 0;
+    }
+}
+
+/* Frame times that have come back, oldest first */
+void readFrameTimes()
+{
+    for(int k=0; k<FRAME_QUERIES; k++)
+    {
+        int q = (queryNext + k) % FRAME_QUERIES;
+        if(!queryBusy[q])
+            continue;
+        GLint ready = 0;
+        glGetQueryObjectiv(frameQueries[q], GL_QUERY_RESULT_AVAILABLE, &ready);
+        if(!ready)
+            break;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(frameQueries[q], GL_QUERY_RESULT, &ns);
+        queryBusy[q] = 0;
+        // Frames from before the last change say nothing about this scale
+        if(queryScale[q] == renderScale)
+            steerScale(ns * 1e-9);
+    }
+}
+
+/* Bind what the scene is drawn into, clear it and start timing */
+void beginScene(GLFWwindow *window)
+{
+    readFrameTimes();
+    int fbwidth, fbheight;
+    glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+    sceneWidth = max(1, (int)lround(fbwidth * renderScale));
+    sceneHeight = max(1, (int)lround(fbheight * renderScale));
+    if(renderScale < 1 && (sceneWidth != allocatedWidth || sceneHeight != allocatedHeight))
+    {
+        glBindRenderbuffer(GL_RENDERBUFFER, sceneColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGB8, sceneWidth, sceneHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, sceneDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, sceneWidth, sceneHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sceneColor);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, sceneDepth);
+        allocatedWidth = sceneWidth;
+        allocatedHeight = sceneHeight;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, renderScale < 1 ? sceneFbo : 0);
+
+    // A frame whose query is still in flight just isn't timed
+    timing = !queryBusy[queryNext];
+    if(timing)
+        glBeginQuery(GL_TIME_ELAPSED, frameQueries[queryNext]);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+/* Scale the scene up to the window, which is bound from here on */
+void endScene(GLFWwindow *window)
+{
+    if(renderScale < 1)
+    {
+        int fbwidth, fbheight;
+        glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, sceneWidth, sceneHeight, 0, 0, fbwidth, fbheight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    if(timing)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        queryBusy[queryNext] = 1;
+        queryScale[queryNext] = renderScale;
+        queryNext = (queryNext + 1) % FRAME_QUERIES;
+    }
+}
+
+/* HUD in the top left corner: level, steps, play time, which bridge
+   groups are out, what to do next and the render scale. It is all one draw call, and only
+   the slots whose text changed go to the GPU again. */
+enum { HUD_LEVEL, HUD_STEPS, HUD_TIME, HUD_BRIDGES, HUD_STATUS, HUD_SCALE, HUD_SLOTS };
+HudText hud;
+VAO *hudText;
+GLuint hudProgram, hudMatrixID, hudColorID, hudAtlas;
+
+void createHud()
+{
+    initHud(hud, HUD_SLOTS);
+    for(int k=0; k<HUD_SLOTS; k++)
+        placeHudSlot(hud, k, 10, 10 + 20*k, 2);
+    hud.changed.clear();
+    hudText = create3DObject(GL_TRIANGLES, hudVertexCount(hud), &hud.pos[0], &hud.uv[0], GL_FILL, GL_DYNAMIC_DRAW);
+
+    vector<unsigned char> pixels;
+    int width, height;
+    buildGlyphAtlas(pixels, width, height);
+    glGenTextures(1, &hudAtlas);
+    glBindTexture(GL_TEXTURE_2D, hudAtlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, &pixels[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    hudProgram = LoadShaders("Hud_GL.vert", "Hud_GL.frag");
+    hudMatrixID = glGetUniformLocation(hudProgram, "MVP");
+    hudColorID = glGetUniformLocation(hudProgram, "textColor");
+}
+
+/* Returns whether any HUD text changed */
+int updateHud()
+{
+    char line[64];
+    if(world)
+        snprintf(line, sizeof(line), "WORLD %d/%d", worldIndex + 1, worldChunkCount(world));
+    else
+        snprintf(line, sizeof(line), "LEVEL %d", currLevel);
+    setHudText(hud, HUD_LEVEL, line);
+    snprintf(line, sizeof(line), "STEPS %d", game.numOfSteps);
+    setHudText(hud, HUD_STEPS, line);
+    // The clock stops when the game ends
+    int seconds = game.endGame && overTime >= 0 ? overTime - startTime : gameTime;
+    snprintf(line, sizeof(line), "TIME %d:%02d", seconds / 60, seconds % 60);
+    setHudText(hud, HUD_TIME, line);
+
+    string bridges;
+    if(game.groups)
+    {
+        bridges = "BRIDGES ";
+        for(int g=0; g<game.groups; g++)
+            bridges += (game.bridges >> g) & 1 ? '0' + g : '-';
+    }
+    setHudText(hud, HUD_BRIDGES, bridges);
+
+    const char *status = "";
+    if(editMode)
+        status = "EDITOR";
+    else if(game.endGame && game.win)
+        status = "YOU WON";
+    else if(game.endGame)
+        status = "FELL - U TO UNDO";
+    setHudText(hud, HUD_STATUS, status);
+
+    // The render scale, while it's below full size
+    line[0] = 0;
+    if(renderScale < 1)
+        snprintf(line, sizeof(line), "RES %d%%", (int)lround(100*renderScale));
+    setHudText(hud, HUD_SCALE, line);
+    return !hud.changed.empty();
+}
+
+void drawHud(GLFWwindow *window)
+{
+    // Upload the changed slots, merging neighbours into one call
+    sort(hud.changed.begin(), hud.changed.end());
+    hud.changed.erase(unique(hud.changed.begin(), hud.changed.end()), hud.changed.end());
+    const int slotFloats = HUD_SLOT_CHARS*6*3;
+    for(size_t k=0; k<hud.changed.size(); )
+    {
+        size_t run = k+1;
+        while(run < hud.changed.size() && hud.changed[run] == hud.changed[run-1]+1)
+            run++;
+        GLintptr offset = hud.changed[k]*slotFloats*sizeof(GLfloat);
+        GLsizeiptr size = (run-k)*slotFloats*sizeof(GLfloat);
+        glBindBuffer(GL_ARRAY_BUFFER, hudText->VertexBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, &hud.pos[hud.changed[k]*slotFloats]);
+        glBindBuffer(GL_ARRAY_BUFFER, hudText->ColorBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, &hud.uv[hud.changed[k]*slotFloats]);
+        k = run;
+    }
+    hud.changed.clear();
+
+    int fbwidth, fbheight;
+    glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+    glViewport(0, 0, fbwidth, fbheight);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(hudProgram);
+    glm::mat4 pixels = glm::ortho(0.0f, (float)fbwidth, (float)fbheight, 0.0f, -1.0f, 1.0f);
+    glUniformMatrix4fv(hudMatrixID, 1, GL_FALSE, &pixels[0][0]);
+    glUniform3f(hudColorID, 1.0f, 1.0f, 0.8f);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, hudAtlas);
+    draw3DObject(hudText);
+    glEnable(GL_DEPTH_TEST);
+}
+
+/* Render on demand: a frame is only drawn when what it shows can have
+   changed, that is the game, the camera, the editor cursor or the window
+   size, or while something is moving. Otherwise the loop sleeps in
+   glfwWaitEventsTimeout(). -continuous draws every vsync instead. */
+int continuous = 0, exposed = 1, recording = 0;
+
+struct FrameKey {
+    GameState game;
+    int view, splitScreen, editMode, cursorRow, cursorCol, heatKind;
+    float cameraAngle;
+    int fbwidth, fbheight;
+};
+
+void frameKey(GLFWwindow *window, FrameKey &key)
+{
+    memset(&key, 0, sizeof(key));
+    key.game = game;
+    key.view = currView;
+    key.splitScreen = splitScreen;
+    key.editMode = editMode;
+    key.cursorRow = cursorRow;
+    key.cursorCol = cursorCol;
+    key.heatKind = heatKind;
+    key.cameraAngle = camera_rotation_angle;
+    glfwGetFramebufferSize(window, &key.fbwidth, &key.fbheight);
+}
+
+/* The block sinking after a win or a fall (a win exits once it's done),
+   debris in the air, or the helicopter camera turning */
+int animating()
+{
+    if(game.endGame && (game.win || glfwGetTime() - overTime < 2.0))
+        return 1;
+    if(debris.count || waitingChunk)
+        return 1;
+    return (currView==5 || splitScreen) && (leftClick || rightClick);
+}
+
+int needFrame(GLFWwindow *window)
+{
+    static FrameKey drawn;
+    FrameKey key;
+    frameKey(window, key);
+    if(!continuous && !recording && !exposed && !animating() && !memcmp(&key, &drawn, sizeof(key)))
+        return 0;
+    drawn = key;
+    exposed = 0;
+    return 1;
+}
+
+void windowRefresh (GLFWwindow* window)
+{
+    exposed = 1;
+}
+
+/* Screenshots (F12) and recording (F11, or from the start with -record
+   dir), written out by the capture writer thread (see capture.h). Each
+   frame is read into the next of a ring of pixel buffer objects:
+   glReadPixels() into a buffer only queues the copy, and a fence says
+   when it is done. The pixels are collected a frame or two later, once
+   their fence has passed, so neither the readback nor the writing ever
+   holds up glfwSwapBuffers(). Recording draws every frame, as
+   -continuous does. */
+#define CAPTURE_PBOS 3
+
+struct CaptureSlot {
+    GLuint pbo;
+    GLsync fence;               // set while a readback into pbo is in flight
+    int width, height;
+    GLsizeiptr size;            // of the storage pbo has
+    string path;
+};
+
+CaptureSlot captureSlots[CAPTURE_PBOS];
+int captureNext = 0, screenshotWanted = 0, recordFrames = 0;
+string recordDir = "capture";
+
+void createCapture()
+{
+    for(CaptureSlot &slot : captureSlots)
+    {
+        glGenBuffers(1, &slot.pbo);
+        slot.fence = 0;
+        slot.size = 0;
+    }
+}
+
+int capturePending()
+{
+    for(CaptureSlot &slot : captureSlots)
+        if(slot.fence)
+            return 1;
+    return 0;
+}
+
+void requestScreenshot()
+{
+    screenshotWanted = 1;
+    exposed = 1;
+}
+
+void toggleRecording()
+{
+    recording = !recording;
+    if(recording)
+    {
+        mkdir(recordDir.c_str(), 0755);
+        printf("Recording to %s/ (F11 to stop)\n", recordDir.c_str());
+    }
+    else
+        printf("Stopped recording after frame %d\n", recordFrames);
+}
+
+/* Queue a readback of the frame just drawn */
+void readFrame(GLFWwindow *window, const string &path)
+{
+    CaptureSlot &slot = captureSlots[captureNext];
+    if(slot.fence)
+    {
+        // The GPU is still busy with the oldest readback
+        captureDropped();
+        return;
+    }
+    glfwGetFramebufferSize(window, &slot.width, &slot.height);
+    GLsizeiptr size = 3*(GLsizeiptr)slot.width*slot.height;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    if(size != slot.size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot.size = size;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, slot.width, slot.height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.path = path;
+    captureNext = (captureNext + 1) % CAPTURE_PBOS;
+}
+
+/* Readbacks for the frame just drawn */
+void captureFrame(GLFWwindow *window)
+{
+    char name[256];
+    if(recording)
+    {
+        snprintf(name, sizeof(name), "%s/frame-%06d.ppm", recordDir.c_str(), recordFrames++);
+        readFrame(window, name);
+    }
+    if(screenshotWanted)
+    {
+        static int shots = 0;
+        do
+            snprintf(name, sizeof(name), "screenshot-%03d.png", ++shots);
+        while(access(name, F_OK) == 0);
+        readFrame(window, name);
+        printf("Saved %s\n", name);
+        screenshotWanted = 0;
+    }
+}
+
+/* Hand the readbacks that have finished over to the writer, oldest first */
+void collectFrames()
+{
+    static vector<unsigned char> pixels;
+    for(int k=0; k<CAPTURE_PBOS; k++)
+    {
+        CaptureSlot &slot = captureSlots[(captureNext + k) % CAPTURE_PBOS];
+        if(!slot.fence)
+            continue;
+        GLenum state = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        // Readbacks finish in order, so the rest aren't done either
+        if(state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+        if(mapped)
+        {
+            pixels.resize(slot.size);
+            memcpy(&pixels[0], mapped, slot.size);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            captureSubmit(slot.path, slot.width, slot.height, pixels);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
+
+/* Frames drawn against time and CPU used, printed at exit and with
+   -stats every 10 seconds. Timed without GLFW, which quit() has shut
+   down by the time this runs at exit. */
+long long framesDrawn = 0, loopWakeups = 0;
+chrono::steady_clock::time_point statsStart = chrono::steady_clock::now();
+
+void reportFrames()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - statsStart).count();
+    printf("%lld frames in %lld wakeups over %.1fs (%.1f fps), %.2fs CPU (%.1f%%)\n", framesDrawn, loopWakeups,
+           wall, wall > 0 ? framesDrawn / wall : 0, cpu, wall > 0 ? 100 * cpu / wall : 0);
+    printf("render scale %.2f, lowest %.2f, frames taking %.1fms on the GPU against a %.1fms budget\n",
+           renderScale, lowestScale, 1e3 * smoothedFrame, 1e3 * frameBudget);
+    printf("level arena %zuK in use, %zuK at most, %zuK held in %zu blocks (%lld allocated)\n", levelArena.inUse / 1024,
+           levelArena.highWater / 1024, arenaCapacity(levelArena) / 1024, levelArena.blocks.size(), levelArena.mallocs);
+    CaptureStats c = captureStats();
+    long long dropped = c.droppedGpu + c.droppedWriter;
+    if(c.captured || dropped)
+        printf("%lld frames captured, %lld dropped (%lld waiting on the GPU, %lld on the writer), %lld written, %lld failed\n",
+               c.captured, dropped, c.droppedGpu, c.droppedWriter, c.written, c.failed);
+}
+
+/* Render the scene with openGL */
+/* Edit this function according to your assignment */
+void draw (GLFWwindow* window, int view, float x, float y, float w, float h)
+{
+    // The scene may be drawn smaller than the window, see beginScene()
+    int fbwidth = sceneWidth, fbheight = sceneHeight;
+    glViewport((int)(x*fbwidth), (int)(y*fbheight), (int)(w*fbwidth), (int)(h*fbheight));
+    // use the loaded shader program
+    // Don't change unless you know what you are doing
+    glUseProgram(programID);
+
+    glm::vec3 eye,up,target;
+    cameraFor(view, eye, target, up);
+    eye += worldOffset;
+    target += worldOffset;
+
     // Compute Camera matrix (view)
     // Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
     //  Don't change unless you are sure!!
     Matrices.view = glm::lookAt(eye, target, up); // Fixed camera for 2D (ortho) in XY plane
 
+    // Each viewport keeps its own aspect ratio
+    Matrices.projectionP = glm::perspective((GLfloat) M_PI/2, (GLfloat) (w*fbwidth) / (GLfloat) (h*fbheight), 0.1f, 500.0f);
+
     // Compute ViewProject matrix as view/camera might not be changed for this frame (basic scenario)
     //  Don't change unless you are sure!!
     glm::mat4 VP = (proj_type?Matrices.projectionP:Matrices.projectionO) * Matrices.view;
@@ -1066,76 +1994,46 @@ void draw (GLFWwindow* window, float x, float y, float w, float h)
     // Send our transformation to the currently bound shader, in the "MVP" uniform
     // For each model you render, since the MVP will be different (at least the M part)
     //  Don't change unless you are sure!!
-    glm::mat4 MVP;	// MVP = Projection * View * Model
-    if(endGame-1==0)
-    {
-        double currTime = glfwGetTime();
-        Matrices.model = glm::mat4(1.0f);
-        glm::mat4 translateBlock = glm::translate (glm::vec3(blockTransX, blockTransY, 0 - 5*(currTime - overTime)));        // glTranslatef
-        Matrices.model *= (translateBlock);
-        MVP = VP * Matrices.model;
-        glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-        draw3DObject(retCurrBlock(currblock));
-        if(currTime - overTime > 2.0)
-            exit(0);
-    }
-    else
+    glm::mat4 MVP = VP * blockModel;	// MVP = Projection * View * Model
+    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+    draw3DObject(retCurrBlock(game.currblock));
+
+    // The board meshes are in level coordinates, moved to their chunk of
+    // the map in open world mode
+    MVP = VP * glm::translate(worldOffset);
+    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+    drawBoard(board, boardMesh.rowVerts);
+    drawHeatOverlay();
+    for(ChunkModel &m : chunkModels)
+        if(m.vao && m.index != worldIndex)
+        {
+            MVP = VP * glm::translate(chunkOffset(m.index));
+            glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+            drawBoard(m.vao, m.rowVerts);
+        }
+
+    if(editMode)
     {
-        Matrices.model = glm::mat4(1.0f);
-        glm::mat4 translateBlock = glm::translate (glm::vec3(blockTransX, blockTransY, 0));        // glTranslatef
-        // glm::mat4 rotateBlock = glm::rotate(blockRotAngle, blockRotAxis); // rotate about vector (-1,1,1)
-        Matrices.model *= (translateBlock);
-        MVP = VP * Matrices.model;
+        MVP = VP * glm::translate (glm::vec3(7-cursorCol, 4-cursorRow, 0));
         glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-        draw3DObject(retCurrBlock(currblock));
+        draw3DObject(cursor);
     }
+    // The debris positions come in as per-instance offsets
+    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &VP[0][0]);
+    drawDebris();
 
-    //Draw the Tile
-    int i=0,j=0;
-    while(i<10)
-    {
-        j=0; i++;
-        while(j<20)
-        {
-            if(level[i-1][j] && level[i-1][j]-3)
-            {
-              Matrices.model = glm::mat4(1.0f);
-              glm::mat4 translateRectangle = glm::translate (glm::vec3(7-j,4-i+1,0));         // glTranslatef
-              Matrices.model *= (translateRectangle);
-              MVP = VP * Matrices.model;
-              glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-              if(level[i-1][j]==4)
-                draw3DObject(fragile);
-              else if(level[i-1][j]==7)
-               {
-                 if(checkH == 1)
-                 draw3DObject(Tile);
-               }
-              else if(level[i-1][j]==8)
-              {
-                if(checkS == 1)
-                draw3DObject(Tile);
-              }
-              else if(level[i-1][j]!=4)
-              {
-                if(level[i-1][j]!=7)
-                {
-                   if(level[i-1][j]!=8)
-                   {
-                     draw3DObject(Tile);
-                   }
-              }
-              if(level[i-1][j]+2==7)
-                draw3DObject(verSwitch);
-              if(level[i-1][j]==6)
-                draw3DObject(horSwitch);
-            }
-          }
-          j++;
-        }
-    }
+    // Mouse picking in the editor works on the full-window view
+    if(w==1 && h==1)
+        pickVP = VP;
 }
 
+/* Viewports for the split screen: block, top and tower views on the top
+   row, follow-cam and helicopter-cam centred underneath */
+const float splitViewports[5][4] = {
+    {0, 0.5, 1/3.0f, 0.5}, {1/3.0f, 0.5, 1/3.0f, 0.5}, {2/3.0f, 0.5, 1/3.0f, 0.5},
+    {1/6.0f, 0, 1/3.0f, 0.5}, {1/2.0f, 0, 1/3.0f, 0.5}
+};
+
 /* Initialise glfw window, I/O callbacks and the renderer to use */
 /* Nothing to Edit here */
 GLFWwindow* initGLFW (int width, int height){
@@ -1167,6 +2065,8 @@ GLFWwindow* initGLFW (int width, int height){
     glfwSetKeyCallback(window, keyboard);      // general keyboard input
     glfwSetCharCallback(window, keyboardChar);  // simpler specific character handling
     glfwSetMouseButtonCallback(window, mouseButton);  // mouse button clicks
+    glfwSetScrollCallback(window, scrollWheel);       // undo history scrubbing
+    glfwSetWindowRefreshCallback(window, windowRefresh);  // redraw when uncovered
 
     return window;
 }
@@ -1175,11 +2075,16 @@ GLFWwindow* initGLFW (int width, int height){
 /* Add all the models to be created here */
 void initGL (GLFWwindow* window, int width, int height)
 {
-    createTile (1);
-    createTile(0);
+    createBoard();
+    createHeatOverlay();
+    createCursor();
     createBlock_Ver();
     createBlock_Alongy();
     createBlock_Alongx();
+    createDebris();
+    createHud();
+    createCapture();
+    createSceneTarget();
     // bridgeBinding();
     // cout<<level1[28];
     programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
@@ -1194,112 +2099,184 @@ void initGL (GLFWwindow* window, int width, int height)
 
 void selectLevel(int lev)
 {
-  FILE * file;
-  char c;
-  switch (lev) {
-      case 1:
-          file = fopen("level01.txt", "r");
-          break;
-      case 2:
-          file = fopen("level02.txt", "r");
-          break;
-      case 3:
-          file = fopen("level03.txt", "r");
-          break;
-      case 4:
-          file = fopen("level04.txt", "r");
-          break;
-      default:
-          file = fopen("level10.txt", "r");
-          break;
-  }
-
-  int i=0,j=0;
-  while(i<10)
+  if(!assetLevel(&game, levelPath(lev)))
   {
-    j=0;
-    while(j<20)
-    {
-      level[i][j] = 0;
-      j++;
-    }
-    i++;
-  }
-  i=0;
-  while(i<10)
-  {j=0;
-    while(j<20)
-    {
-      c = getc(file);
-      if(c=='-')
-        level[i][j] = 0;
-      else if(c=='o')
-        level[i][j] = 1;
-      else if(c=='S')
-      {
-        level[i][j] = 2;
-        blockTransY = 4 - i;
-        blockTransX = 7 - j;
-      }
-      else if(c=='T')
-        level[i][j] = 3;
-      else if(c=='.')
-        level[i][j] = 4;
-      else if(c=='h')
-      {
-        level[i][j] = 5;
-        createVerSwitch();
-      }
-      else if(c=='s')
-      {
-        level[i][j] = 6;
-        createHorSwitch();
-      }
-      else if(c=='H')
-        level[i][j] = 7;
-      else if(c=='B')
-        level[i][j] = 8;
-      else if(c == '\n' || c == EOF)
-      {
-        break;
-      }
-      j++;
-    }
-    if(c == EOF)
-    {
-      fclose(file);
-      break;
-    }
-    i++;
+    fprintf(stderr, "Could not load %s\n", levelPath(lev));
+    exit(EXIT_FAILURE);
   }
+  startLevelData();
+  telemetryLog(EV_LEVEL_START, &game, lev);
   return ;
 }
 
+/* Carry on from a save read by readSave() into game */
+void resumeLevel(const SaveExtras &extras)
+{
+  currLevel = extras.level;
+  currView = extras.view >= 1 && extras.view <= 5 ? extras.view : 3;
+  splitScreen = extras.splitScreen != 0;
+  camera_rotation_angle = extras.cameraAngle;
+  startLevelData();
+  telemetryLog(EV_LEVEL_START, &game, currLevel);
+}
+
 int main (int argc, char** argv)
 {
-    printf("Select the level you want to play : ");
-    scanf("%d",&currLevel);
-    currblock = 1;
+    // -spectate [port] streams the game to spectator clients,
+    // -particles n sets the size of the debris pool,
+    // -telemetry file logs every gameplay event to file,
+    // -save file saves the game there rather than in bloxorz.sav,
+    // -statstore file records every attempt there rather than in bloxorz.stats,
+    // -new starts a new game even if there is one to resume,
+    // -continuous draws every vsync rather than on demand,
+    // -stats prints frame and CPU counts every 10 seconds,
+    // -world file plays the levels of an open world map (see world.h),
+    // -record dir records every frame into dir from the start (F11 toggles),
+    // -budget ms sets the frame time the render scale is steered to,
+    // -scale f draws the scene at f times the window size instead,
+    // -heatmap file tints the board with a heatmap from heatgen ('h' cycles)
+    int fresh = 0, stats = 0;
+    const char *worldPath = NULL, *statsPath = "bloxorz.stats";
+    for(int i=1; i<argc; i++)
+        if(!strcmp(argv[i], "-spectate"))
+        {
+            int port = i+1 < argc ? atoi(argv[i+1]) : 0;
+            if(!spectateStart(port > 0 ? port : 7777))
+                fprintf(stderr, "Could not start the spectator server\n");
+            atexit(spectateStop);
+        }
+        else if(!strcmp(argv[i], "-particles") && i+1 < argc)
+            debrisCount = max(2, atoi(argv[++i]));
+        else if(!strcmp(argv[i], "-telemetry") && i+1 < argc)
+        {
+            if(!telemetryStart(argv[++i]))
+                fprintf(stderr, "Could not open %s\n", argv[i]);
+            atexit(telemetryStop);
+        }
+        else if(!strcmp(argv[i], "-save") && i+1 < argc)
+            savePath = argv[++i];
+        else if(!strcmp(argv[i], "-statstore") && i+1 < argc)
+            statsPath = argv[++i];
+        else if(!strcmp(argv[i], "-new"))
+            fresh = 1;
+        else if(!strcmp(argv[i], "-continuous"))
+            continuous = 1;
+        else if(!strcmp(argv[i], "-stats"))
+            stats = 1;
+        else if(!strcmp(argv[i], "-world") && i+1 < argc)
+            worldPath = argv[++i];
+        else if(!strcmp(argv[i], "-budget") && i+1 < argc)
+            frameBudget = max(1.0, atof(argv[++i])) / 1000;
+        else if(!strcmp(argv[i], "-scale") && i+1 < argc)
+            fixedScale = max((double)SCALE_MIN, min(1.0, atof(argv[++i])));
+        else if(!strcmp(argv[i], "-heatmap") && i+1 < argc)
+        {
+            if(readHeatmap(heat, argv[++i]))
+                heatKind = HEAT_VISITS;
+            else
+            {
+                fprintf(stderr, "Could not read the heatmap in %s\n", argv[i]);
+                heat.level.clear();
+            }
+        }
+        else if(!strcmp(argv[i], "-record") && i+1 < argc)
+        {
+            recordDir = argv[++i];
+            recording = 1;
+        }
+
+    if(worldPath && !(world = openWorld(worldPath, 2)))
+    {
+        fprintf(stderr, "Could not read the world in %s\n", worldPath);
+        exit(EXIT_FAILURE);
+    }
+    if(!statsOpen(statsPath))
+        fprintf(stderr, "Could not open %s, attempts won't be recorded\n", statsPath);
+    atexit(statsClose);
+    SaveExtras resumed;
+    int resume = !world && !fresh && readSave(savePath, &game, &resumed);
+    if(resume)
+        printf("Resuming level %d (start with -new to pick a level)\n", resumed.level);
+    else if(!world)
+    {
+        printf("Select the level you want to play : ");
+        scanf("%d",&currLevel);
+    }
     int width = 600;
     int height = 600;
     GLFWwindow* window = initGLFW(width, height);
     proj_type = 1;
     initGLEW();
     initGL (window, width, height);
-    selectLevel(currLevel);
+    if(world)
+    {
+        startWorld();
+        atexit(stopWorld);
+    }
+    else if(resume)
+        resumeLevel(resumed);
+    else
+        selectLevel(currLevel);
+    spectatePublish(&game);
+    atexit(stopChecker);
+    // The open world isn't saved
+    if(!world)
+    {
+        saveStart(savePath);
+        atexit(saveStop);
+    }
 
     double last_update_time = glfwGetTime(), current_time;
-    startTime = last_update_time;
+    startTime = last_update_time - (resume ? resumed.gameTime : 0);
+    double lastStats = last_update_time;
+    atexit(reportFrames);
+    captureStart();
+    atexit(captureStop);
+    if(recording)
+    {
+        recording = 0;
+        toggleRecording();
+    }
 
     /* Draw in loop */
     while (!glfwWindowShouldClose(window)) {
 
-	     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-       draw(window, 0, 0, 1, 1);
-       glfwSwapBuffers(window);
-       glfwPollEvents();
+       loopWakeups++;
+       collectFrames();
+       if(editMode)
+           showEditorStatus(window);
+       int worldChanged = streamWorld();
+       int hudChanged = updateHud();
+       if(needFrame(window) || hudChanged || worldChanged)
+       {
+         prepareFrame();
+         beginScene(window);
+         if(splitScreen)
+         {
+             for(int v=0; v<5; v++)
+                 draw(window, v+1, splitViewports[v][0], splitViewports[v][1], splitViewports[v][2], splitViewports[v][3]);
+         }
+         else
+             draw(window, currView, 0, 0, 1, 1);
+         endScene(window);
+         drawHud(window);
+         captureFrame(window);
+         glfwSwapBuffers(window);
+         framesDrawn++;
+         glfwPollEvents();
+       }
+       else
+           // The editor's solvability check shows up in the title, so
+           // look for it more often, and for readbacks in flight
+           glfwWaitEventsTimeout(capturePending() ? 0.01 : editMode ? 0.1 : 0.5);
        current_time = glfwGetTime(); // Time in seconds
        gameTime = current_time - startTime;
+       autosave();
+       if(stats && current_time - lastStats >= 10)
+       {
+           reportFrames();
+           lastStats = current_time;
+       }
     }
 
     glfwTerminate();
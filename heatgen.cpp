@@ -0,0 +1,220 @@
+/* Heatmap of where players go on one level, from recorded plays.
+ *
+ *   heatgen [-j threads] [-l number] [-o out.heat] level.txt corpus ...
+ *
+ * A corpus file is either text, one play per line as a string of moveKey()
+ * keys with u and r for undo and redo (lines starting with # are skipped),
+ * or a log written by sample2D -telemetry, from which the plays of the
+ * level are taken: the one numbered in the level file's name, or -l's.
+ * Plays in a log that lost events, or were resumed from a save part way
+ * through, are left out, since they can't be replayed.
+ *
+ * The plays are split into chunks of whole lines that the threads take in
+ * turn, each replaying into a heatmap of its own (see heatmap.h); those
+ * are added up once all are done, so nothing is shared while replaying.
+ * The result goes to out.heat, by default the level's name with .heat in
+ * place of .txt, for sample2D -heatmap to show over the board.
+ */
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "rules.h"
+#include "heatmap.h"
+#include "telemetry.h"
+
+using namespace std;
+
+// Bytes of plays each thread takes at a time
+static const size_t chunkBytes = 1 << 20;
+
+/* The whole of the file at path appended to text. Returns 0 on failure. */
+static int readFile(const char *path, string &text)
+{
+    FILE *f = fopen(path, "rb");
+    if(!f)
+        return 0;
+    char buf[1 << 16];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        text.append(buf, n);
+    int ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+/* The plays of level in a telemetry log, as lines of keys appended to
+   plays. Returns the plays that had to be left out. */
+static int logPlays(const string &log, int level, string &plays)
+{
+    string keys;
+    int playing = 0, lost = 0, skipped = 0;
+    auto endPlay = [&]() {
+        if(playing && !lost)
+            plays += keys + '\n';
+        skipped += playing && lost;
+        playing = lost = 0;
+        keys.clear();
+    };
+    for(size_t at=0; at+12 <= log.size(); at += 12)
+    {
+        if(!memcmp(&log[at], "BLXT", 4))
+        {
+            endPlay();
+            continue;
+        }
+        TelemetryEvent e;
+        memcpy(&e, &log[at], sizeof(e));
+        if(e.type == EV_LEVEL_START)
+        {
+            endPlay();
+            playing = e.value == level;
+            // A play resumed from a save doesn't start at the start
+            lost = e.steps != 0;
+        }
+        else if(e.type == EV_MOVE)
+            keys += (char)e.value;
+        else if(e.type == EV_REWIND)
+            // value is the step undo or redo left from, steps where it went
+            keys.append(abs(e.value - e.steps), e.steps < e.value ? 'u' : 'r');
+        else if(e.type == EV_DROPPED)
+            lost = 1;
+    }
+    endPlay();
+    return skipped;
+}
+
+int main (int argc, char** argv)
+{
+    int threads = thread::hardware_concurrency(), level = -1;
+    const char *levelFile = NULL, *outPath = NULL;
+    vector<const char*> corpus;
+    for(int i=1; i<argc; i++)
+    {
+        if(!strcmp(argv[i], "-j") && i+1 < argc)
+            threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-l") && i+1 < argc)
+            level = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-o") && i+1 < argc)
+            outPath = argv[++i];
+        else if(!levelFile)
+            levelFile = argv[i];
+        else
+            corpus.push_back(argv[i]);
+    }
+    if(threads < 1)
+        threads = 1;
+    if(!levelFile || corpus.empty())
+    {
+        fprintf(stderr, "usage: heatgen [-j threads] [-l number] [-o out.heat] level.txt corpus ...\n");
+        return 2;
+    }
+    GameState start;
+    if(!loadLevel(&start, levelFile))
+    {
+        fprintf(stderr, "Could not load %s\n", levelFile);
+        return 2;
+    }
+    Heatmap total;
+    heatClear(total, levelFile);
+    if(level < 0)
+        sscanf(total.level.c_str(), "level%d", &level);
+    string out = outPath ? outPath : total.level;
+    if(!outPath)
+        out = out.substr(0, out.rfind(".txt")) + ".heat";
+
+    auto began = chrono::steady_clock::now();
+    string plays;
+    for(const char *path : corpus)
+    {
+        string text;
+        if(!readFile(path, text))
+        {
+            fprintf(stderr, "Could not read %s\n", path);
+            return 2;
+        }
+        if(!text.compare(0, 4, "BLXT"))
+        {
+            int skipped = logPlays(text, level, plays);
+            if(skipped)
+                fprintf(stderr, "%s: %d plays left out, resumed or with events lost\n", path, skipped);
+        }
+        else
+        {
+            plays += text;
+            if(!plays.empty() && plays.back() != '\n')
+                plays += '\n';
+        }
+    }
+
+    // Chunks end just after a newline, so no play is split between two
+    vector<size_t> chunks(1, 0);
+    while(chunks.back() < plays.size())
+    {
+        size_t end = min(chunks.back() + chunkBytes, plays.size());
+        const void *nl = memchr(&plays[end-1], '\n', plays.size() - (end-1));
+        chunks.push_back(nl ? (const char*)nl - plays.data() + 1 : plays.size());
+    }
+
+    threads = max(1, min(threads, (int)chunks.size() - 1));
+    vector<Heatmap> heat(threads);
+    atomic<size_t> nextChunk(0);
+    vector<thread> pool;
+    for(int t=0; t<threads; t++)
+    {
+        heatClear(heat[t], levelFile);
+        pool.push_back(thread([&, t]() {
+            vector<char> moves;
+            vector<HeatPose> poses;
+            size_t c;
+            while((c = nextChunk++) + 1 < chunks.size())
+            {
+                const char *p = plays.data() + chunks[c], *end = plays.data() + chunks[c+1];
+                while(p < end)
+                {
+                    const char *nl = (const char*)memchr(p, '\n', end - p);
+                    if(*p != '#' && *p != '\n')
+                        heatReplay(&start, p, nl - p, heat[t], moves, poses);
+                    p = nl + 1;
+                }
+            }
+        }));
+    }
+    for(auto &t : pool)
+        t.join();
+    for(const Heatmap &h : heat)
+        heatMerge(total, h);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - began).count();
+
+    if(!writeHeatmap(total, out.c_str()))
+    {
+        fprintf(stderr, "Could not write %s\n", out.c_str());
+        return 2;
+    }
+    printf("%s: %lld plays, %lld moves, %lld wins, %lld falls in %.2fs on %d threads (%.0f plays/s)\n",
+           out.c_str(), total.plays, total.moves, total.wins, total.falls, seconds, threads,
+           total.plays / max(seconds, 1e-9));
+    // Where the most plays end, to start looking
+    for(int k=HEAT_FALLS; k<HEAT_KINDS; k++)
+    {
+        long long most = 0;
+        int row = 0, col = 0;
+        for(int i=0; i<LEVEL_ROWS; i++)
+            for(int j=0; j<LEVEL_COLS; j++)
+                if(total.count[k][i][j] > most)
+                {
+                    most = total.count[k][i][j];
+                    row = i;
+                    col = j;
+                }
+        if(most)
+            printf("most %s: %lld at row %d, col %d\n", heatName(k), most, row, col);
+    }
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include <cstring>
+
+#include "heatmap.h"
+
+using namespace std;
+
+void heatClear(Heatmap &h, const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    h.level = slash ? slash + 1 : path;
+    h.plays = h.moves = h.wins = h.falls = 0;
+    memset(h.count, 0, sizeof(h.count));
+}
+
+/* Add one to kind at the cells the block covers in s, where they're on
+   the board */
+static void countBlock(Heatmap &h, int kind, const GameState *s)
+{
+    int row = blockRow(s), col = blockCol(s);
+    if(row >= 0 && row < LEVEL_ROWS && col >= 0 && col < LEVEL_COLS)
+        h.count[kind][row][col]++;
+    if(s->currblock == B_ALONGY)
+        row--;
+    else if(s->currblock == B_ALONGX)
+        col--;
+    else
+        return;
+    if(row >= 0 && row < LEVEL_ROWS && col >= 0 && col < LEVEL_COLS)
+        h.count[kind][row][col]++;
+}
+
+static void savePose(const GameState *s, HeatPose &p)
+{
+    p.blockTransX = s->blockTransX;
+    p.blockTransY = s->blockTransY;
+    p.currblock = s->currblock;
+    p.bridges = s->bridges;
+    p.endGame = s->endGame;
+    p.win = s->win;
+    p.numOfSteps = s->numOfSteps;
+    p.brokeRow = p.brokeCol = -1;
+}
+
+/* Undo the move made from p: the pose comes back, and the tile it broke */
+static void restorePose(GameState *s, const HeatPose &p)
+{
+    s->blockTransX = p.blockTransX;
+    s->blockTransY = p.blockTransY;
+    s->currblock = p.currblock;
+    s->bridges = p.bridges;
+    s->endGame = p.endGame;
+    s->win = p.win;
+    s->numOfSteps = p.numOfSteps;
+    if(p.brokeRow >= 0)
+        s->level[p.brokeRow][p.brokeCol] = T_FRAGILE;
+}
+
+/* moveKey() from the pose saved in p, noting a broken tile there. A
+   break ends the game and undoing it mends the tile, so before any move
+   the board is the one the level started with. */
+static void playMove(const GameState *start, GameState *s, char key, HeatPose &p)
+{
+    savePose(s, p);
+    moveKey(s, key);
+    int row = blockRow(s), col = blockCol(s);
+    if(s->endGame && !s->win && s->currblock == B_STANDING && tileAt(start, row, col) == T_FRAGILE)
+    {
+        p.brokeRow = row;
+        p.brokeCol = col;
+    }
+}
+
+void heatReplay(const GameState *start, const char *keys, size_t n, Heatmap &h,
+                vector<char> &moves, vector<HeatPose> &poses)
+{
+    GameState s = *start;
+    moves.clear();
+    poses.clear();
+    size_t at = 0;      // moves made, as undo and redo see it
+    h.plays++;
+    countBlock(h, HEAT_VISITS, &s);
+    for(size_t k=0; k<n; k++)
+    {
+        char key = keys[k];
+        if(key == 'u')
+        {
+            if(at > 0)
+                restorePose(&s, poses[--at]);
+            continue;
+        }
+        if(key == 'r')
+        {
+            if(at < moves.size())
+            {
+                playMove(start, &s, moves[at], poses[at]);
+                at++;
+            }
+            continue;
+        }
+        if((key != 'U' && key != 'D' && key != 'R' && key != 'L') || s.endGame)
+            continue;
+
+        // A new move drops the moves that could have been redone
+        moves.resize(at);
+        poses.resize(at);
+        moves.push_back(key);
+        poses.push_back(HeatPose());
+        HeatPose &p = poses.back();
+        playMove(start, &s, key, p);
+        at++;
+        h.moves++;
+        if(s.win)
+        {
+            h.wins++;
+            countBlock(h, HEAT_VISITS, &s);
+        }
+        else if(s.endGame)
+        {
+            h.falls++;
+            if(p.brokeRow >= 0)
+                h.count[HEAT_BREAKS][p.brokeRow][p.brokeCol]++;
+            else
+            {
+                GameState before = s;
+                restorePose(&before, p);
+                countBlock(h, HEAT_FALLS, &before);
+            }
+        }
+        else
+            countBlock(h, HEAT_VISITS, &s);
+    }
+}
+
+void heatMerge(Heatmap &a, const Heatmap &b)
+{
+    a.plays += b.plays;
+    a.moves += b.moves;
+    a.wins += b.wins;
+    a.falls += b.falls;
+    for(int k=0; k<HEAT_KINDS; k++)
+        for(int i=0; i<LEVEL_ROWS; i++)
+            for(int j=0; j<LEVEL_COLS; j++)
+                a.count[k][i][j] += b.count[k][i][j];
+}
+
+const char *heatName(int kind)
+{
+    static const char *names[HEAT_KINDS] = { "visits", "falls", "breaks" };
+    return kind >= 0 && kind < HEAT_KINDS ? names[kind] : "?";
+}
+
+int writeHeatmap(const Heatmap &h, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if(!f)
+        return 0;
+    fprintf(f, "heatmap %s\n", h.level.c_str());
+    fprintf(f, "plays %lld moves %lld wins %lld falls %lld\n", h.plays, h.moves, h.wins, h.falls);
+    for(int k=0; k<HEAT_KINDS; k++)
+    {
+        fprintf(f, "%s\n", heatName(k));
+        for(int i=0; i<LEVEL_ROWS; i++)
+            for(int j=0; j<LEVEL_COLS; j++)
+                fprintf(f, "%lld%c", h.count[k][i][j], j == LEVEL_COLS-1 ? '\n' : ' ');
+    }
+    return !fclose(f);
+}
+
+int readHeatmap(Heatmap &h, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if(!f)
+        return 0;
+    char level[256] = "", name[16];
+    int ok = fscanf(f, "heatmap %255s plays %lld moves %lld wins %lld falls %lld", level,
+                    &h.plays, &h.moves, &h.wins, &h.falls) == 5;
+    h.level = level;
+    for(int k=0; k<HEAT_KINDS && ok; k++)
+    {
+        ok = fscanf(f, "%15s", name) == 1 && !strcmp(name, heatName(k));
+        for(int i=0; i<LEVEL_ROWS && ok; i++)
+            for(int j=0; j<LEVEL_COLS && ok; j++)
+                ok = fscanf(f, "%lld", &h.count[k][i][j]) == 1;
+    }
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,63 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <string>
+#include <vector>
+
+#include "rules.h"
+
+/* Where players go on a level, added up over many recorded plays.
+ *
+ * A play is a string of moveKey() keys, U D R L, plus u and r for the
+ * game's undo and redo; anything else in it is skipped. heatReplay() plays
+ * one through moveBlock() from the level's start and counts, per cell:
+ *   visits  every position the block stops on without falling, the start
+ *           included, for each cell it covers; undo and redo don't count
+ *   falls   the cells the block was on before a move that fell off
+ *   breaks  fragile tiles broken by standing on them
+ * so the numbers follow the game's rules and not whatever the recording
+ * says happened.
+ *
+ * On disk a heatmap is text: a "heatmap <level file>" line, a line with
+ * the totals, then each grid under its name as LEVEL_ROWS lines of
+ * LEVEL_COLS counts, laid out like the level file.
+ */
+
+#define HEAT_VISITS 0
+#define HEAT_FALLS  1
+#define HEAT_BREAKS 2
+#define HEAT_KINDS  3
+
+struct Heatmap {
+    std::string level;      // the level file's name, without directories
+    long long plays, moves, wins, falls;
+    long long count[HEAT_KINDS][LEVEL_ROWS][LEVEL_COLS];
+};
+
+/* Block pose and what a move can change besides, for undoing it */
+struct HeatPose {
+    float blockTransX, blockTransY;
+    int currblock;
+    unsigned bridges;
+    int endGame, win, numOfSteps;
+    int brokeRow, brokeCol;     // -1 unless the move broke a fragile tile
+};
+
+/* A clear heatmap for the level file at path */
+void heatClear(Heatmap &h, const char *path);
+
+/* Replay the play in keys[0..n) on start and add it to h. moves and poses
+   are scratch space, reused from one play to the next. */
+void heatReplay(const GameState *start, const char *keys, size_t n, Heatmap &h,
+                std::vector<char> &moves, std::vector<HeatPose> &poses);
+
+/* Add the counts of b into a */
+void heatMerge(Heatmap &a, const Heatmap &b);
+
+const char *heatName(int kind);
+
+/* Returns 0 if the file can't be written or read */
+int writeHeatmap(const Heatmap &h, const char *path);
+int readHeatmap(Heatmap &h, const char *path);
+
+#endif
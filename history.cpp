@@ -0,0 +1,180 @@
+#include <cstring>
+#include <algorithm>
+
+#include "history.h"
+
+using namespace std;
+
+static HistoryEntry entryFor(const GameState *s, uint32_t board)
+{
+    HistoryEntry e;
+    e.transX = (int8_t)s->blockTransX;
+    e.transY = (int8_t)s->blockTransY;
+    e.lastMoveUp = s->lastMoveUp;
+    e.lastMoveRight = s->lastMoveRight;
+    e.currblock = s->currblock;
+    e.bridges = s->bridges;
+    e.endGame = s->endGame;
+    e.win = s->win;
+    e.steps = s->numOfSteps;
+    e.board = board;
+    return e;
+}
+
+static const int *rowAt(const History &h, uint32_t board, int i)
+{
+    return &h.rows[(size_t)h.boards[board*LEVEL_ROWS + i] * LEVEL_COLS];
+}
+
+static uint32_t addRow(History &h, const int *tiles)
+{
+    memcpy(&h.rows[h.rowCount * LEVEL_COLS], tiles, LEVEL_COLS * sizeof(int));
+    return h.rowCount++;
+}
+
+/* Just the position in s, in the arrays already there */
+static void restart(History &h, const GameState *s)
+{
+    h.rowCount = 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        h.boards[i] = addRow(h, s->level[i]);
+    h.boardCount = 1;
+    h.entries[0] = entryFor(s, 0);
+    h.count = 1;
+    h.current = 0;
+}
+
+void historyReset(History &h, const GameState *s, Arena &arena, size_t limit)
+{
+    int fragile = 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            fragile += s->level[i][j] == T_FRAGILE;
+    h.limit = limit < 4 ? 4 : limit;
+    h.boardLimit = fragile + 1;
+    h.rowLimit = LEVEL_ROWS + fragile;
+    h.entries = arenaArray<HistoryEntry>(arena, h.limit + 1);
+    h.boards = arenaArray<uint32_t>(arena, h.boardLimit * LEVEL_ROWS);
+    h.rows = arenaArray<int>(arena, h.rowLimit * LEVEL_COLS);
+    h.renumber = arenaArray<uint32_t>(arena, h.rowLimit);
+    restart(h, s);
+}
+
+/* Drop the positions after the current one, and the boards and rows only
+   they used. Boards and rows are only ever appended, so both are a prefix
+   of what is kept. */
+static void dropRedo(History &h)
+{
+    h.count = h.current + 1;
+    uint32_t board = h.entries[h.current].board;
+    h.boardCount = board + 1;
+    uint32_t last = 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        last = max(last, h.boards[board*LEVEL_ROWS + i]);
+    h.rowCount = last + 1;
+}
+
+/* Drop the oldest quarter of the positions, renumbering the boards and
+   rows that are still used. Rows keep their order, so each one only
+   moves down and it can all be done in place. */
+static void dropOldest(History &h)
+{
+    size_t drop = h.count - h.limit * 3 / 4;
+    memmove(h.entries, h.entries + drop, (h.count - drop) * sizeof(HistoryEntry));
+    h.count -= drop;
+    h.current -= drop;
+
+    uint32_t first = h.entries[0].board;
+    h.boardCount -= first;
+    memmove(h.boards, h.boards + first*LEVEL_ROWS, h.boardCount * LEVEL_ROWS * sizeof(uint32_t));
+    for(size_t r=0; r<h.rowCount; r++)
+        h.renumber[r] = UINT32_MAX;
+    for(size_t k=0; k<h.boardCount*LEVEL_ROWS; k++)
+        h.renumber[h.boards[k]] = 0;
+    size_t kept = 0;
+    for(size_t r=0; r<h.rowCount; r++)
+        if(h.renumber[r] != UINT32_MAX)
+        {
+            if(kept != r)
+                memcpy(&h.rows[kept * LEVEL_COLS], &h.rows[r * LEVEL_COLS], LEVEL_COLS * sizeof(int));
+            h.renumber[r] = kept++;
+        }
+    h.rowCount = kept;
+    for(size_t k=0; k<h.boardCount*LEVEL_ROWS; k++)
+        h.boards[k] = h.renumber[h.boards[k]];
+    for(size_t e=0; e<h.count; e++)
+        h.entries[e].board -= first;
+}
+
+void historyRecord(History &h, const GameState *s)
+{
+    if(h.current + 1 < h.count)
+        dropRedo(h);
+
+    // A new board version only when a row has changed, sharing the rest
+    uint32_t board = h.entries[h.current].board;
+    int changed = 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        changed += memcmp(rowAt(h, board, i), s->level[i], sizeof(s->level[i])) != 0;
+    if(changed && (h.boardCount == h.boardLimit || h.rowCount + changed > h.rowLimit))
+    {
+        // Only a board changed by something other than fragile tiles
+        // breaking could get here; play on without the moves before
+        restart(h, s);
+        return;
+    }
+    if(changed)
+    {
+        uint32_t next = h.boardCount++;
+        for(int i=0; i<LEVEL_ROWS; i++)
+        {
+            uint32_t r = h.boards[board*LEVEL_ROWS + i];
+            if(memcmp(rowAt(h, board, i), s->level[i], sizeof(s->level[i])))
+                r = addRow(h, s->level[i]);
+            h.boards[next*LEVEL_ROWS + i] = r;
+        }
+        board = next;
+    }
+
+    h.entries[h.count++] = entryFor(s, board);
+    h.current++;
+    if(h.count > h.limit)
+        dropOldest(h);
+}
+
+int historySeek(History &h, GameState *s, size_t index)
+{
+    if(index >= h.count)
+        return 0;
+    const HistoryEntry &e = h.entries[index];
+    int board = e.board != h.entries[h.current].board;
+    s->blockTransX = e.transX;
+    s->blockTransY = e.transY;
+    s->lastMoveUp = e.lastMoveUp;
+    s->lastMoveRight = e.lastMoveRight;
+    s->currblock = e.currblock;
+    s->bridges = e.bridges;
+    s->endGame = e.endGame;
+    s->win = e.win;
+    s->numOfSteps = e.steps;
+    for(int i=0; i<LEVEL_ROWS && board; i++)
+        memcpy(s->level[i], rowAt(h, e.board, i), sizeof(s->level[i]));
+    h.current = index;
+    return 1;
+}
+
+int historyUndo(History &h, GameState *s)
+{
+    return h.current > 0 && historySeek(h, s, h.current - 1);
+}
+
+int historyRedo(History &h, GameState *s)
+{
+    return historySeek(h, s, h.current + 1);
+}
+
+size_t historyBytes(const History &h)
+{
+    return (h.limit + 1) * sizeof(HistoryEntry) + h.boardLimit * LEVEL_ROWS * sizeof(uint32_t)
+         + h.rowLimit * (LEVEL_COLS * sizeof(int) + sizeof(uint32_t));
+}
@@ -0,0 +1,69 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <cstdint>
+
+#include "rules.h"
+#include "arena.h"
+
+/* Undo/redo history of one play of a level.
+ *
+ * Every position the block has been in is a 16 byte entry: the pose,
+ * switches, flags and step count, plus the board version it was on.
+ * Boards are shared rather than copied: a board version is a list of row
+ * indices, and when a move breaks a fragile tile only the row it was in is
+ * stored again. Undo, redo and jumping to any position are O(1).
+ *
+ * Playing on after an undo drops the positions that could have been
+ * redone. Once there are more than limit positions the oldest quarter is
+ * dropped, so memory stays bounded however long a session runs.
+ *
+ * All of it lives in arrays taken from an arena when the history is reset
+ * and never grown: only broken fragile tiles change the board, so a level
+ * with f of them has at most f+1 board versions and LEVEL_ROWS+f rows in
+ * any one line of play. Recording, undo and redo never allocate.
+ */
+
+#define HISTORY_LIMIT (1 << 18)
+
+struct HistoryEntry {
+    int8_t transX, transY;        // blockTransX, blockTransY
+    int8_t lastMoveUp, lastMoveRight;
+    uint8_t currblock, bridges;
+    uint8_t endGame, win;
+    uint32_t steps;               // numOfSteps
+    uint32_t board;               // index into History::boards
+};
+
+struct History {
+    HistoryEntry *entries;          // limit+1 of them
+    size_t count, current;          // entries kept, and the one being played
+    size_t limit;
+    uint32_t *boards;               // LEVEL_ROWS row indices per board version
+    size_t boardCount, boardLimit;  // in board versions
+    int *rows;                      // LEVEL_COLS tiles per row
+    size_t rowCount, rowLimit;      // in rows
+    uint32_t *renumber;             // rowLimit of them, for dropping old rows
+};
+
+/* Start a history at the position in s, dropping everything before. Its
+   arrays come out of arena, which should be reset along with it. */
+void historyReset(History &h, const GameState *s, Arena &arena, size_t limit=HISTORY_LIMIT);
+
+/* Add the position s has just moved to, after the current one */
+void historyRecord(History &h, const GameState *s);
+
+/* Put s, which must be at the current position, back to the previous
+   (undo) or next (redo) one. Return 0, leaving s alone, when there is
+   none. */
+int historyUndo(History &h, GameState *s);
+int historyRedo(History &h, GameState *s);
+
+/* The same for position index, counted from the oldest one kept. Returns
+   0 when index is out of range. */
+int historySeek(History &h, GameState *s, size_t index);
+
+/* Memory set aside for the history */
+size_t historyBytes(const History &h);
+
+#endif
@@ -0,0 +1,148 @@
+#include <cstring>
+
+#include "hud.h"
+
+using namespace std;
+
+static const char glyphChars[] = " 0123456789:./-+%ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+#define GLYPH_COUNT ((int)sizeof(glyphChars) - 1)
+
+/* GLYPH_H rows per glyph, bit 4 is the leftmost pixel */
+static const unsigned char glyphRows[GLYPH_COUNT][GLYPH_H] = {
+    {0x00,0x00,0x00,0x00,0x00,0x00,0x00},   // space
+    {0x0E,0x11,0x13,0x15,0x19,0x11,0x0E},   // 0
+    {0x04,0x0C,0x04,0x04,0x04,0x04,0x0E},
+    {0x0E,0x11,0x01,0x02,0x04,0x08,0x1F},
+    {0x1F,0x02,0x04,0x02,0x01,0x11,0x0E},
+    {0x02,0x06,0x0A,0x12,0x1F,0x02,0x02},
+    {0x1F,0x10,0x1E,0x01,0x01,0x11,0x0E},
+    {0x06,0x08,0x10,0x1E,0x11,0x11,0x0E},
+    {0x1F,0x01,0x02,0x04,0x08,0x08,0x08},
+    {0x0E,0x11,0x11,0x0E,0x11,0x11,0x0E},
+    {0x0E,0x11,0x11,0x0F,0x01,0x02,0x0C},   // 9
+    {0x00,0x0C,0x0C,0x00,0x0C,0x0C,0x00},   // :
+    {0x00,0x00,0x00,0x00,0x00,0x0C,0x0C},   // .
+    {0x00,0x01,0x02,0x04,0x08,0x10,0x00},   // /
+    {0x00,0x00,0x00,0x1F,0x00,0x00,0x00},   // -
+    {0x00,0x04,0x04,0x1F,0x04,0x04,0x00},   // +
+    {0x18,0x19,0x02,0x04,0x08,0x13,0x03},   // %
+    {0x0E,0x11,0x11,0x1F,0x11,0x11,0x11},   // A
+    {0x1E,0x11,0x11,0x1E,0x11,0x11,0x1E},
+    {0x0E,0x11,0x10,0x10,0x10,0x11,0x0E},
+    {0x1C,0x12,0x11,0x11,0x11,0x12,0x1C},
+    {0x1F,0x10,0x10,0x1E,0x10,0x10,0x1F},
+    {0x1F,0x10,0x10,0x1E,0x10,0x10,0x10},
+    {0x0E,0x11,0x10,0x17,0x11,0x11,0x0F},
+    {0x11,0x11,0x11,0x1F,0x11,0x11,0x11},
+    {0x0E,0x04,0x04,0x04,0x04,0x04,0x0E},
+    {0x07,0x02,0x02,0x02,0x02,0x12,0x0C},
+    {0x11,0x12,0x14,0x18,0x14,0x12,0x11},
+    {0x10,0x10,0x10,0x10,0x10,0x10,0x1F},
+    {0x11,0x1B,0x15,0x15,0x11,0x11,0x11},
+    {0x11,0x11,0x19,0x15,0x13,0x11,0x11},
+    {0x0E,0x11,0x11,0x11,0x11,0x11,0x0E},
+    {0x1E,0x11,0x11,0x1E,0x10,0x10,0x10},
+    {0x0E,0x11,0x11,0x11,0x15,0x12,0x0D},
+    {0x1E,0x11,0x11,0x1E,0x14,0x12,0x11},
+    {0x0F,0x10,0x10,0x0E,0x01,0x01,0x1E},
+    {0x1F,0x04,0x04,0x04,0x04,0x04,0x04},
+    {0x11,0x11,0x11,0x11,0x11,0x11,0x0E},
+    {0x11,0x11,0x11,0x11,0x11,0x0A,0x04},
+    {0x11,0x11,0x11,0x15,0x15,0x15,0x0A},
+    {0x11,0x11,0x0A,0x04,0x0A,0x11,0x11},
+    {0x11,0x11,0x11,0x0A,0x04,0x04,0x04},
+    {0x1F,0x01,0x02,0x04,0x08,0x10,0x1F},   // Z
+};
+
+#define CELL_W (GLYPH_W + 1)
+#define CELL_H (GLYPH_H + 1)
+#define CHAR_FLOATS (6*3)
+
+static int glyphIndex(char c)
+{
+    if(c >= 'a' && c <= 'z')
+        c += 'A' - 'a';
+    const char *p = c ? strchr(glyphChars, c) : NULL;
+    return p ? p - glyphChars : 0;
+}
+
+void buildGlyphAtlas(vector<unsigned char> &pixels, int &width, int &height)
+{
+    width = GLYPH_COUNT * CELL_W;
+    height = CELL_H;
+    pixels.assign(width * height, 0);
+    for(int g=0; g<GLYPH_COUNT; g++)
+        for(int r=0; r<GLYPH_H; r++)
+            for(int c=0; c<GLYPH_W; c++)
+                if(glyphRows[g][r] & (0x10 >> c))
+                    pixels[r*width + g*CELL_W + c] = 255;
+}
+
+/* Write the quads of one slot; the ones past the end of the text get no
+   area */
+static void layoutSlot(HudText &h, int slot)
+{
+    const float atlasW = GLYPH_COUNT * CELL_W;
+    const string &text = h.text[slot];
+    float *pos = &h.pos[slot * HUD_SLOT_CHARS * CHAR_FLOATS];
+    float *uv = &h.uv[slot * HUD_SLOT_CHARS * CHAR_FLOATS];
+    memset(pos, 0, HUD_SLOT_CHARS * CHAR_FLOATS * sizeof(float));
+    memset(uv, 0, HUD_SLOT_CHARS * CHAR_FLOATS * sizeof(float));
+    float scale = h.scale[slot];
+    for(size_t i=0; i<text.size() && i<HUD_SLOT_CHARS; i++)
+    {
+        int g = glyphIndex(text[i]);
+        if(!g)
+            continue;
+        float x0 = h.x[slot] + i*CELL_W*scale, y0 = h.y[slot];
+        float x1 = x0 + GLYPH_W*scale, y1 = y0 + GLYPH_H*scale;
+        float u0 = g*CELL_W / atlasW, u1 = (g*CELL_W + GLYPH_W) / atlasW;
+        float v0 = 0, v1 = GLYPH_H / (float)CELL_H;
+        const float corners[6][4] = {
+            {x0, y0, u0, v0}, {x1, y0, u1, v0}, {x1, y1, u1, v1},
+            {x0, y0, u0, v0}, {x1, y1, u1, v1}, {x0, y1, u0, v1},
+        };
+        for(int v=0; v<6; v++)
+        {
+            float *p = pos + (i*6 + v)*3, *t = uv + (i*6 + v)*3;
+            p[0] = corners[v][0];
+            p[1] = corners[v][1];
+            t[0] = corners[v][2];
+            t[1] = corners[v][3];
+        }
+    }
+    h.changed.push_back(slot);
+}
+
+void initHud(HudText &h, int slots)
+{
+    h.text.assign(slots, string());
+    h.x.assign(slots, 0);
+    h.y.assign(slots, 0);
+    h.scale.assign(slots, 1);
+    h.pos.assign(slots * HUD_SLOT_CHARS * CHAR_FLOATS, 0);
+    h.uv.assign(slots * HUD_SLOT_CHARS * CHAR_FLOATS, 0);
+    h.changed.clear();
+}
+
+void placeHudSlot(HudText &h, int slot, float x, float y, float scale)
+{
+    h.x[slot] = x;
+    h.y[slot] = y;
+    h.scale[slot] = scale;
+    layoutSlot(h, slot);
+}
+
+int setHudText(HudText &h, int slot, const string &text)
+{
+    if(h.text[slot] == text)
+        return 0;
+    h.text[slot] = text;
+    layoutSlot(h, slot);
+    return 1;
+}
+
+int hudVertexCount(const HudText &h)
+{
+    return h.text.size() * HUD_SLOT_CHARS * 6;
+}
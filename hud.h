@@ -0,0 +1,43 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <string>
+#include <vector>
+
+/* On-screen text, drawn from one glyph atlas texture in a single call.
+ *
+ * Text goes in fixed slots. Each slot owns HUD_SLOT_CHARS quads (six
+ * vertices each) at a fixed place in the vertex arrays; characters past
+ * the end of the string are zero-sized, so the whole HUD is one draw of
+ * hudVertexCount() vertices and a changed string only rewrites, and
+ * re-uploads, its own slot. Positions are in pixels from the top left of
+ * the window, texture coordinates are into the atlas. Both are 3 floats a
+ * vertex, to go through the same kind of buffers as every other mesh.
+ */
+
+#define HUD_SLOT_CHARS 24
+
+/* The built-in 5x7 font: a space, digits, capitals and ":./-+%"; lower case
+   letters are drawn as capitals and anything else as a space */
+#define GLYPH_W 5
+#define GLYPH_H 7
+
+struct HudText {
+    std::vector<std::string> text;       // per slot
+    std::vector<float> x, y, scale;      // per slot: top left, pixels per font pixel
+    std::vector<float> pos, uv;          // per vertex
+    std::vector<int> changed;            // slots rewritten since the caller last cleared it
+};
+
+void initHud(HudText &h, int slots);
+/* Move a slot; its text is laid out again */
+void placeHudSlot(HudText &h, int slot, float x, float y, float scale);
+/* Returns 0, touching nothing, when the slot already shows text */
+int setHudText(HudText &h, int slot, const std::string &text);
+int hudVertexCount(const HudText &h);
+
+/* The atlas: one (GLYPH_W+1) x (GLYPH_H+1) cell per glyph in a single row,
+   one byte per pixel, 255 where the glyph is lit */
+void buildGlyphAtlas(std::vector<unsigned char> &pixels, int &width, int &height);
+
+#endif
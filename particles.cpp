@@ -0,0 +1,97 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "particles.h"
+
+using namespace std;
+
+static const float gravity = 9.8;
+
+void initParticles(Particles &p, int capacity)
+{
+    // Rounded up so the four-wide kernel never runs off the end
+    int padded = (capacity + 3) & ~3;
+    p.capacity = capacity;
+    p.count = 0;
+    p.seed = 2463534242u;
+    p.x.assign(padded, 0);
+    p.y.assign(padded, 0);
+    p.z.assign(padded, 0);
+    p.vx.assign(padded, 0);
+    p.vy.assign(padded, 0);
+    p.vz.assign(padded, 0);
+    p.life.assign(padded, 0);
+}
+
+/* xorshift32, mapped to [0, 1) */
+static float randomUnit(unsigned &seed)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return (seed >> 8) * (1.0f / 16777216);
+}
+
+int emitParticles(Particles &p, float x, float y, float z, int n)
+{
+    if(n > p.capacity - p.count)
+        n = p.capacity - p.count;
+    for(int k=0; k<n; k++)
+    {
+        int i = p.count++;
+        p.x[i] = x + randomUnit(p.seed);
+        p.y[i] = y + randomUnit(p.seed);
+        p.z[i] = z;
+        p.vx[i] = 4*randomUnit(p.seed) - 2;
+        p.vy[i] = 4*randomUnit(p.seed) - 2;
+        p.vz[i] = 1 + 4*randomUnit(p.seed);
+        p.life[i] = 1.5 + 0.5*randomUnit(p.seed);
+    }
+    return n;
+}
+
+void updateParticles(Particles &p, float dt)
+{
+    float *x = &p.x[0], *y = &p.y[0], *z = &p.z[0];
+    float *vx = &p.vx[0], *vy = &p.vy[0], *vz = &p.vz[0], *life = &p.life[0];
+    int i = 0;
+#ifdef __SSE2__
+    __m128 step = _mm_set1_ps(dt), fall = _mm_set1_ps(gravity*dt);
+    for(; i+4 <= p.count; i+=4)
+    {
+        __m128 v = _mm_sub_ps(_mm_loadu_ps(vz+i), fall);
+        _mm_storeu_ps(vz+i, v);
+        _mm_storeu_ps(z+i, _mm_add_ps(_mm_loadu_ps(z+i), _mm_mul_ps(v, step)));
+        _mm_storeu_ps(x+i, _mm_add_ps(_mm_loadu_ps(x+i), _mm_mul_ps(_mm_loadu_ps(vx+i), step)));
+        _mm_storeu_ps(y+i, _mm_add_ps(_mm_loadu_ps(y+i), _mm_mul_ps(_mm_loadu_ps(vy+i), step)));
+        _mm_storeu_ps(life+i, _mm_sub_ps(_mm_loadu_ps(life+i), step));
+    }
+#endif
+    for(; i<p.count; i++)
+    {
+        vz[i] -= gravity*dt;
+        z[i] += vz[i]*dt;
+        x[i] += vx[i]*dt;
+        y[i] += vy[i]*dt;
+        life[i] -= dt;
+    }
+
+    // Fill each dead slot from the end, keeping the live ones packed
+    for(i=0; i<p.count; )
+    {
+        if(life[i] > 0)
+        {
+            i++;
+            continue;
+        }
+        int last = --p.count;
+        x[i] = x[last];
+        y[i] = y[last];
+        z[i] = z[last];
+        vx[i] = vx[last];
+        vy[i] = vy[last];
+        vz[i] = vz[last];
+        life[i] = life[last];
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <vector>
+
+/* Debris thrown off when the block falls or a fragile tile breaks. Each
+   attribute is its own array (structure of arrays), so the update runs
+   four particles at a time and the positions go to the GPU as they are,
+   one buffer per coordinate. All storage is allocated up front; live
+   particles are always the first count entries. */
+struct Particles {
+    int capacity, count;
+    std::vector<float> x, y, z;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> life;            // seconds left
+    unsigned seed;
+};
+
+void initParticles(Particles &p, int capacity);
+
+/* Throw up to n particles out of the cell-sized square at (x, y, z).
+   Returns how many fitted in the pool. */
+int emitParticles(Particles &p, float x, float y, float z, int n);
+
+/* Move every particle on by dt seconds under gravity and drop the ones
+   whose time is up */
+void updateParticles(Particles &p, float dt);
+
+#endif
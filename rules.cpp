@@ -0,0 +1,308 @@
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rules.h"
+
+using namespace std;
+
+const char *levelPath(int lev)
+{
+    switch (lev) {
+        case 1:
+            return "level01.txt";
+        case 2:
+            return "level02.txt";
+        case 3:
+            return "level03.txt";
+        case 4:
+            return "level04.txt";
+        default:
+            return "level10.txt";
+    }
+}
+
+void countGroups(GameState *s)
+{
+    s->groups = 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+        {
+            int t = s->level[i][j];
+            if((t == T_HSWITCH || t == T_SSWITCH || t == T_HBRIDGE || t == T_SBRIDGE) && s->group[i][j] >= s->groups)
+                s->groups = s->group[i][j] + 1;
+        }
+}
+
+/* A "link <group> <row>,<col> ..." line; cells that aren't a switch or
+   a bridge are ignored */
+static void readLink(GameState *s, const char *c)
+{
+    int group, used;
+    if(sscanf(c, "link %d%n", &group, &used) != 1 || group < 0 || group >= MAX_BRIDGE_GROUPS)
+        return;
+    c += used;
+    int row, col;
+    while(sscanf(c, " %d,%d%n", &row, &col, &used) == 2)
+    {
+        c += used;
+        if(row < 0 || row >= LEVEL_ROWS || col < 0 || col >= LEVEL_COLS)
+            continue;
+        int t = s->level[row][col];
+        if(t == T_HSWITCH || t == T_SSWITCH || t == T_HBRIDGE || t == T_SBRIDGE)
+            s->group[row][col] = group;
+    }
+}
+
+int readLevel(GameState *s, const char *text)
+{
+    int start = 0;
+    memset(s, 0, sizeof(*s));
+    s->currblock = B_STANDING;
+
+    const char *c = text;
+    int i=0,j=0;
+    while(i<LEVEL_ROWS && *c && strncmp(c, "link", 4))
+    {
+        j=0;
+        while(j<LEVEL_COLS && *c && *c!='\n')
+        {
+            if(*c=='o')
+                s->level[i][j] = T_TILE;
+            else if(*c=='S')
+            {
+                s->level[i][j] = T_START;
+                s->blockTransY = 4 - i;
+                s->blockTransX = 7 - j;
+                start = 1;
+            }
+            else if(*c=='T')
+                s->level[i][j] = T_GOAL;
+            else if(*c=='.')
+                s->level[i][j] = T_FRAGILE;
+            else if(*c=='h')
+                s->level[i][j] = T_HSWITCH;
+            else if(*c=='s')
+                s->level[i][j] = T_SSWITCH;
+            else if(*c=='H')
+                s->level[i][j] = T_HBRIDGE;
+            else if(*c=='B')
+                s->level[i][j] = T_SBRIDGE;
+            s->group[i][j] = defaultGroup(s->level[i][j]);
+            c++; j++;
+        }
+        // Anything past the last column belongs to this row, not the next
+        while(*c && *c!='\n')
+            c++;
+        if(*c=='\n')
+            c++;
+        i++;
+    }
+
+    // Link lines, after the grid
+    for(; *c; c++)
+    {
+        if(!strncmp(c, "link", 4))
+            readLink(s, c);
+        while(*c && *c!='\n')
+            c++;
+        if(!*c)
+            break;
+    }
+
+    countGroups(s);
+    return start;
+}
+
+/* Read with open() into a buffer each thread keeps, rather than through
+   a FILE and a new string, so loading levels over and over doesn't
+   allocate */
+int loadLevel(GameState *s, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return 0;
+    static thread_local string text;
+    text.clear();
+    char buf[512];
+    ssize_t n;
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+        text.append(buf, n);
+    close(fd);
+    return n == 0 && readLevel(s, text.c_str());
+}
+
+int resetToStart(GameState *s)
+{
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            if(s->level[i][j] == T_START)
+            {
+                s->blockTransY = 4 - i;
+                s->blockTransX = 7 - j;
+                s->currblock = B_STANDING;
+                s->lastMoveUp = s->lastMoveRight = 0;
+                s->bridges = 0;
+                s->endGame = s->win = 0;
+                s->numOfSteps = 0;
+                return 1;
+            }
+    return 0;
+}
+
+string formatLevel(const GameState *s)
+{
+    static const char chars[] = "-oST.hsHB";
+    int width = 1;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            if(s->level[i][j] && j+1 > width)
+                width = j+1;
+
+    string text;
+    for(int i=0; i<LEVEL_ROWS; i++)
+    {
+        for(int j=0; j<width; j++)
+            text += chars[s->level[i][j]];
+        text += '\n';
+    }
+
+    for(int g=0; g<MAX_BRIDGE_GROUPS; g++)
+    {
+        string link;
+        for(int i=0; i<LEVEL_ROWS; i++)
+            for(int j=0; j<LEVEL_COLS; j++)
+            {
+                int t = s->level[i][j];
+                if((t == T_HSWITCH || t == T_SSWITCH || t == T_HBRIDGE || t == T_SBRIDGE) &&
+                   s->group[i][j] == g && g != defaultGroup(t))
+                    link += " " + to_string(i) + "," + to_string(j);
+            }
+        if(!link.empty())
+            text += "link " + to_string(g) + link + "\n";
+    }
+    return text;
+}
+
+void checkSwitch(GameState *s)
+{
+    int blockx = blockCol(s);
+    int blocky = blockRow(s);
+
+    if(tileAt(s, blocky, blockx)==T_HSWITCH && s->currblock==B_STANDING)
+        s->bridges ^= 1u << s->group[blocky][blockx];
+    else if(s->currblock!=B_STANDING)
+    {
+        // A group toggles once even when both halves are on its switches
+        int row2 = s->currblock==B_ALONGY ? blocky-1 : blocky;
+        int col2 = s->currblock==B_ALONGX ? blockx-1 : blockx;
+        unsigned flip = 0;
+        if(tileAt(s, blocky, blockx)==T_SSWITCH)
+            flip |= 1u << s->group[blocky][blockx];
+        if(tileAt(s, row2, col2)==T_SSWITCH)
+            flip |= 1u << s->group[row2][col2];
+        s->bridges ^= flip;
+    }
+}
+
+/* Is there nothing for the block to rest on at (row, col)? */
+static int unsupported(const GameState *s, int row, int col)
+{
+    int tile = tileAt(s, row, col);
+    if(tile==T_HBRIDGE || tile==T_SBRIDGE)
+        return !bridgeOut(s, row, col);
+    return tile==T_EMPTY;
+}
+
+void checkGameOver(GameState *s)
+{
+    int blockx = blockCol(s);
+    int blocky = blockRow(s);
+    int tile = tileAt(s, blocky, blockx);
+
+    // tileAt() reads off-board cells as empty, so leaving the board is a fall
+    if(unsupported(s, blocky, blockx))
+        s->endGame = 1;
+    else if(s->currblock == B_STANDING)
+    {
+        if(tile==T_GOAL)
+        {
+            s->endGame = 1;
+            s->win = 1;
+        }
+        else if(tile==T_FRAGILE)
+        {
+            s->endGame = 1;
+            s->level[blocky][blockx]=T_EMPTY;
+        }
+    }
+    else if(s->currblock == B_ALONGY)
+    {
+        if(unsupported(s, blocky-1, blockx))
+            s->endGame = 1;
+    }
+    else
+    {
+        if(unsupported(s, blocky, blockx-1))
+            s->endGame = 1;
+    }
+}
+
+void moveBlock(GameState *s, int moveUp, int moveRight)
+{
+    // Once the block has fallen or won, the board is frozen
+    if(s->endGame)
+        return ;
+    if(moveUp!=0)
+    {
+        if(s->currblock == B_STANDING)
+        {
+            s->blockTransY += moveUp - (1-moveUp)/2 ;
+            s->currblock = B_ALONGY;
+        }
+        else if(s->currblock == B_ALONGY)
+        {
+            s->blockTransY += moveUp + (1+moveUp)/2 ;
+            s->currblock = B_STANDING;
+        }
+        else
+        {
+            s->blockTransY += moveUp ;
+        }
+        s->lastMoveUp = moveUp;
+    }
+    else if(moveRight!=0)
+    {
+        if(s->currblock == B_STANDING)
+        {
+            s->blockTransX += moveRight - (1-moveRight)/2;
+            s->currblock = B_ALONGX;
+        }
+        else if(s->currblock == B_ALONGX)
+        {
+            s->blockTransX += moveRight + (1+moveRight)/2 ;
+            s->currblock = B_STANDING;
+        }
+        else
+        {
+            s->blockTransX += moveRight ;
+        }
+        s->lastMoveRight = moveRight;
+    }
+    s->numOfSteps++;
+    checkGameOver(s);
+    checkSwitch(s);
+}
+
+void moveKey(GameState *s, char key)
+{
+    switch (key) {
+        case 'U': moveBlock(s, 1, 0); break;
+        case 'D': moveBlock(s, -1, 0); break;
+        case 'R': moveBlock(s, 0, 1); break;
+        case 'L': moveBlock(s, 0, -1); break;
+        default: break;
+    }
+}
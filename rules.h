@@ -0,0 +1,107 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include <cstdio>
+#include <string>
+
+/* Board dimensions used by the level files */
+#define LEVEL_ROWS 10
+#define LEVEL_COLS 20
+
+/* Tile codes stored in level[][] (see readLevel for the characters) */
+#define T_EMPTY   0   // '-'
+#define T_TILE    1   // 'o'
+#define T_START   2   // 'S'
+#define T_GOAL    3   // 'T'
+#define T_FRAGILE 4   // '.'
+#define T_HSWITCH 5   // 'h'
+#define T_SSWITCH 6   // 's'
+#define T_HBRIDGE 7   // 'H'
+#define T_SBRIDGE 8   // 'B'
+
+/* Block orientations stored in currblock */
+#define B_STANDING 1
+#define B_ALONGY   2
+#define B_ALONGX   3
+
+/* Bump whenever a change to the rules below can change how a level plays;
+   results cached on disk (solvecache.h) are keyed on it */
+#define RULES_VERSION 2
+
+/* Switches and bridges come in numbered groups: a switch toggles the
+   bridges of its own group and no others. Unless the level file says
+   otherwise, 'h' and 'H' are in group 0 and 's' and 'B' in group 1. */
+#define MAX_BRIDGE_GROUPS 8
+
+/* Everything the rules need to know about a game in progress.
+   The block covers cell (4-blockTransY, 7-blockTransX) and, when lying,
+   the cell above it (ALONGY) or to its left (ALONGX) in level[][]. */
+struct GameState {
+    int level[LEVEL_ROWS][LEVEL_COLS];
+    unsigned char group[LEVEL_ROWS][LEVEL_COLS];   // of each switch and bridge
+    float blockTransX, blockTransY;
+    int currblock;
+    int lastMoveUp, lastMoveRight;
+    int groups;            // 1 + the highest group in use, 0 without switches
+    unsigned bridges;      // bit g set while the bridges of group g are out
+    int endGame, win;
+    int numOfSteps;
+};
+
+/* Set s->groups from the switches and bridges on the board */
+void countGroups(GameState *s);
+
+/* Level file for a level number, as prompted for in main() */
+const char *levelPath(int lev);
+
+/* Parse a level in the text format into s and reset the block onto 'S'.
+   The grid may be followed by lines putting switches and bridges in other
+   groups, each "link <group> <row>,<col> <row>,<col> ...".
+   Returns 0 if the text has no start tile. */
+int readLevel(GameState *s, const char *text);
+/* Same as readLevel, reading the text from a file. Returns 0 on failure. */
+int loadLevel(GameState *s, const char *path);
+/* Put the block back standing on 'S', every switch off and no moves made,
+   as readLevel() leaves it; the board is kept as it is. Returns 0 if the
+   board has no start tile. */
+int resetToStart(GameState *s);
+/* Write the board of s back out in the level file format, with link lines
+   for cells outside their default group. Fragile tiles that have broken
+   are written as '-'. */
+std::string formatLevel(const GameState *s);
+
+/* Tile at (row, col), or T_EMPTY when outside the board */
+inline int tileAt(const GameState *s, int row, int col)
+{
+    if(row < 0 || row >= LEVEL_ROWS || col < 0 || col >= LEVEL_COLS)
+        return T_EMPTY;
+    return s->level[row][col];
+}
+
+/* Is the bridge group of cell (row, col) extended? */
+inline int bridgeOut(const GameState *s, int row, int col)
+{
+    return (s->bridges >> s->group[row][col]) & 1;
+}
+
+/* The group a switch or bridge tile is in when no link line moves it */
+constexpr int defaultGroup(int tile)
+{
+    return tile == T_SSWITCH || tile == T_SBRIDGE;
+}
+
+inline int blockCol(const GameState *s) { return 7 - s->blockTransX; }
+inline int blockRow(const GameState *s) { return 4 - s->blockTransY; }
+
+void checkSwitch(GameState *s);
+void checkGameOver(GameState *s);
+
+/* Roll the block one step (moveUp/moveRight are -1, 0 or 1, one of them
+   non-zero), then apply the tile rules for where it lands. Does nothing
+   once the game has ended. */
+void moveBlock(GameState *s, int moveUp, int moveRight);
+/* moveBlock() for a move written as a key: U/D are moveUp = 1/-1,
+   R/L are moveRight = 1/-1 */
+void moveKey(GameState *s, char key);
+
+#endif
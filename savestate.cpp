@@ -0,0 +1,236 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "savestate.h"
+
+using namespace std;
+
+/* The file is this record as it is in memory, little-endian */
+struct SaveFile {
+    char magic[4];
+    uint32_t version;
+    uint32_t checksum;      // of everything after it
+    int32_t level;
+    float gameTime, cameraAngle;
+    uint32_t numOfSteps;
+    int8_t transX, transY, lastMoveUp, lastMoveRight;
+    uint8_t currblock, bridges, endGame, win;
+    uint8_t view, splitScreen;
+    uint8_t cells[LEVEL_ROWS][LEVEL_COLS];   // tile | group << 4
+    uint8_t unused[2];
+};
+
+static_assert(sizeof(SaveFile) == 240, "the save format is 240 bytes");
+
+static const char saveMagic[4] = { 'B', 'L', 'X', 'S' };
+
+static uint32_t checksumOf(const SaveFile &f)
+{
+    const unsigned char *p = (const unsigned char *)&f.level;
+    const unsigned char *end = (const unsigned char *)(&f + 1);
+    uint32_t h = 2166136261u;
+    for(; p < end; p++)
+    {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void encode(SaveFile &f, const GameState *s, const SaveExtras *extras)
+{
+    memset(&f, 0, sizeof(f));
+    memcpy(f.magic, saveMagic, 4);
+    f.version = SAVE_VERSION;
+    f.level = extras->level;
+    f.gameTime = extras->gameTime;
+    f.cameraAngle = extras->cameraAngle;
+    f.numOfSteps = s->numOfSteps;
+    f.transX = (int8_t)s->blockTransX;
+    f.transY = (int8_t)s->blockTransY;
+    f.lastMoveUp = s->lastMoveUp;
+    f.lastMoveRight = s->lastMoveRight;
+    f.currblock = s->currblock;
+    f.bridges = s->bridges;
+    f.endGame = s->endGame;
+    f.win = s->win;
+    f.view = extras->view;
+    f.splitScreen = extras->splitScreen;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            f.cells[i][j] = s->level[i][j] | s->group[i][j] << 4;
+    f.checksum = checksumOf(f);
+}
+
+static int decode(const SaveFile &f, GameState *s, SaveExtras *extras)
+{
+    if(memcmp(f.magic, saveMagic, 4) || f.version != SAVE_VERSION || f.checksum != checksumOf(f))
+        return 0;
+    if(f.currblock < B_STANDING || f.currblock > B_ALONGX || f.bridges >= 1u << MAX_BRIDGE_GROUPS)
+        return 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            if((f.cells[i][j] & 15) > T_SBRIDGE || (f.cells[i][j] >> 4) >= MAX_BRIDGE_GROUPS)
+                return 0;
+
+    memset(s, 0, sizeof(*s));
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+        {
+            s->level[i][j] = f.cells[i][j] & 15;
+            s->group[i][j] = f.cells[i][j] >> 4;
+        }
+    countGroups(s);
+    s->blockTransX = f.transX;
+    s->blockTransY = f.transY;
+    s->lastMoveUp = f.lastMoveUp;
+    s->lastMoveRight = f.lastMoveRight;
+    s->currblock = f.currblock;
+    s->bridges = f.bridges;
+    s->endGame = f.endGame;
+    s->win = f.win;
+    s->numOfSteps = f.numOfSteps;
+    extras->level = f.level;
+    extras->gameTime = f.gameTime;
+    extras->cameraAngle = f.cameraAngle;
+    extras->view = f.view;
+    extras->splitScreen = f.splitScreen;
+    return 1;
+}
+
+static int writeFile(const char *path, const SaveFile &f)
+{
+    // The new save is on disk before it replaces the old one, and the
+    // rename is on disk before we return
+    string tmp = string(path) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return 0;
+    int ok = write(fd, &f, sizeof(f)) == (ssize_t)sizeof(f);
+    ok &= fsync(fd) == 0;
+    ok &= close(fd) == 0;
+    if(!ok || rename(tmp.c_str(), path) != 0)
+    {
+        unlink(tmp.c_str());
+        return 0;
+    }
+    const char *slash = strrchr(path, '/');
+    string dir = slash ? string(path, slash - path + 1) : ".";
+    int dirfd = open(dir.c_str(), O_RDONLY);
+    if(dirfd >= 0)
+    {
+        fsync(dirfd);
+        close(dirfd);
+    }
+    return 1;
+}
+
+int writeSave(const char *path, const GameState *s, const SaveExtras *extras)
+{
+    SaveFile f;
+    encode(f, s, extras);
+    return writeFile(path, f);
+}
+
+int readSave(const char *path, GameState *s, SaveExtras *extras)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return 0;
+    SaveFile f;
+    int ok = read(fd, &f, sizeof(f)) == (ssize_t)sizeof(f);
+    close(fd);
+    return ok && decode(f, s, extras);
+}
+
+/**************************
+ * Writer thread          *
+ **************************/
+
+enum { PENDING_NONE, PENDING_WRITE, PENDING_REMOVE };
+
+static mutex slotLock;
+static condition_variable wake;
+static SaveFile pending;
+static int pendingKind = PENDING_NONE;
+static int running = 0;
+static thread writer;
+static string savePath;
+
+static void writeLoop()
+{
+    unique_lock<mutex> lock(slotLock);
+    for(;;)
+    {
+        wake.wait(lock, []() { return pendingKind != PENDING_NONE || !running; });
+        if(pendingKind == PENDING_NONE)
+            return;
+        int kind = pendingKind;
+        SaveFile f = pending;
+        pendingKind = PENDING_NONE;
+        lock.unlock();
+        if(kind == PENDING_REMOVE)
+            unlink(savePath.c_str());
+        else if(!writeFile(savePath.c_str(), f))
+        {
+            static int warned = 0;
+            if(!warned++)
+                fprintf(stderr, "Could not save the game to %s\n", savePath.c_str());
+        }
+        lock.lock();
+    }
+}
+
+void saveStart(const char *path)
+{
+    lock_guard<mutex> guard(slotLock);
+    if(running)
+        return;
+    savePath = path;
+    running = 1;
+    writer = thread(writeLoop);
+}
+
+void saveStop()
+{
+    {
+        lock_guard<mutex> guard(slotLock);
+        if(!running)
+            return;
+        running = 0;
+    }
+    wake.notify_one();
+    writer.join();
+}
+
+void savePublish(const GameState *s, const SaveExtras *extras)
+{
+    SaveFile f;
+    encode(f, s, extras);
+    {
+        lock_guard<mutex> guard(slotLock);
+        if(!running)
+            return;
+        pending = f;
+        pendingKind = PENDING_WRITE;
+    }
+    wake.notify_one();
+}
+
+void saveClear()
+{
+    {
+        lock_guard<mutex> guard(slotLock);
+        if(!running)
+            return;
+        pendingKind = PENDING_REMOVE;
+    }
+    wake.notify_one();
+}
@@ -0,0 +1,43 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "rules.h"
+
+/* Save file for resuming a game after a restart or a power cut.
+ *
+ * A save is one 240 byte record: "BLXS", the version, an FNV-1a checksum
+ * of the rest, then the level number, play time, camera, block pose,
+ * switches and step count, and every cell of the board with its bridge
+ * group (so broken fragile tiles and editor changes come back too).
+ *
+ * It is written to a temporary file, fsynced and renamed over the old
+ * save, so a crash at any point leaves either the old save or the new one.
+ * A save with the wrong version or checksum is ignored.
+ */
+
+#define SAVE_VERSION 1
+
+/* What a save holds besides the GameState */
+struct SaveExtras {
+    int level;              // level number, for levelPath()
+    float gameTime;         // seconds played
+    int view, splitScreen;  // currView and the split screen toggle
+    float cameraAngle;      // camera_rotation_angle
+};
+
+/* Write a save now, returning 0 on failure */
+int writeSave(const char *path, const GameState *s, const SaveExtras *extras);
+/* Read a save back; returns 0, leaving s alone, when there is no valid
+   save at path */
+int readSave(const char *path, GameState *s, SaveExtras *extras);
+
+/* Saving from the game: savePublish() only hands the state over, and a
+   writer thread writes the latest one published, so the game never waits
+   for the disk. saveClear() removes the save (after a win). saveStop()
+   writes whatever is still pending. */
+void saveStart(const char *path);
+void saveStop();
+void savePublish(const GameState *s, const SaveExtras *extras);
+void saveClear();
+
+#endif
@@ -0,0 +1,445 @@
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "scene.h"
+
+using namespace std;
+
+// Cells each baking thread should get before the pool is worth waking
+static const int bakePerThread = 32;
+
+/* Switch markers, drawn just above the tile in black */
+static const float hardSwitchVertices[6*3] = {
+    0.25,0.25,0.1,
+    0.25,0.75,0.1,
+    0.75,0.75,0.1,
+
+    0.25,0.25,0.1,
+    0.75,0.25,0.1,
+    0.75,0.75,0.1
+};
+
+static const float softSwitchVertices[3*3] = {
+    0.25,0.25,0.1,
+    0.5,0.5,0.1,
+    0.75,0.25,0.1
+};
+
+/* Marker colour for each bridge group; the two default groups stay black */
+static const float markerColors[MAX_BRIDGE_GROUPS][3] = {
+    {0,0,0}, {0,0,0}, {0.9,0.9,0.9}, {0.1,0.3,0.9},
+    {0.1,0.6,0.1}, {0.9,0.9,0.1}, {0.1,0.8,0.8}, {0.8,0.1,0.8}
+};
+
+int cellLook(const GameState *s, int row, int col)
+{
+    switch (s->level[row][col]) {
+        case T_TILE:
+        case T_START:
+            return LOOK_TILE;
+        case T_FRAGILE:
+            return LOOK_FRAGILE;
+        case T_HSWITCH:
+            return LOOK_HSWITCH;
+        case T_SSWITCH:
+            return LOOK_SSWITCH;
+        case T_HBRIDGE:
+        case T_SBRIDGE:
+            return bridgeOut(s, row, col) ? LOOK_TILE : LOOK_NONE;
+        default:
+            return LOOK_NONE;
+    }
+}
+
+void initBoardMesh(BoardMesh &mesh)
+{
+    mesh.pos.assign(3*BOARD_VERTS, 0);
+    mesh.color.assign(3*BOARD_VERTS, 0);
+    for(int i=0; i<LEVEL_ROWS; i++)
+    {
+        for(int j=0; j<LEVEL_COLS; j++)
+            mesh.look[i][j] = -1;
+        mesh.rowVerts[i] = 0;
+    }
+    memset(mesh.dirty, 0, sizeof(mesh.dirty));
+    mesh.dirtyCount = 0;
+    mesh.bridges = 0;
+    mesh.bridgeCount = 0;
+    markBoardAll(mesh);
+}
+
+void markBoardCell(BoardMesh &mesh, int row, int col)
+{
+    if(row < 0 || row >= LEVEL_ROWS || col < 0 || col >= LEVEL_COLS || mesh.dirty[row][col])
+        return;
+    mesh.dirty[row][col] = 1;
+    mesh.dirtyCells[mesh.dirtyCount++] = row*LEVEL_COLS + col;
+}
+
+void markBlockCells(BoardMesh &mesh, const GameState *s)
+{
+    int row = blockRow(s), col = blockCol(s);
+    markBoardCell(mesh, row, col);
+    if(s->currblock == B_ALONGY)
+        markBoardCell(mesh, row-1, col);
+    else if(s->currblock == B_ALONGX)
+        markBoardCell(mesh, row, col-1);
+}
+
+void markBoardAll(BoardMesh &mesh)
+{
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            markBoardCell(mesh, i, j);
+    mesh.bridgesStale = 1;
+}
+
+int boardTriangles(const BoardMesh &mesh)
+{
+    int verts = 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        verts += mesh.rowVerts[i];
+    return verts / 3;
+}
+
+/* Light from above, a little towards the default camera */
+static const float lightDir[3] = { 0.37, -0.28, 0.88 };
+
+/* Directional light on a face with outward normal n */
+static float shadeFor(float nx, float ny, float nz)
+{
+    float diffuse = nx*lightDir[0] + ny*lightDir[1] + nz*lightDir[2];
+    return 0.35 + 0.65*(diffuse > 0 ? diffuse : 0);
+}
+
+/* Looks with a border of empty cells, so neighbours need no bounds checks */
+typedef int PaddedLooks[LEVEL_ROWS+2][LEVEL_COLS+2];
+
+static int solidAt(const PaddedLooks &looks, int i, int j)
+{
+    return (looks[i+1][j+1] & 7) != LOOK_NONE;
+}
+
+/* Appends two triangles at a time to one row's vertex range */
+struct RowWriter {
+    float *pos, *color;
+    int n;
+};
+
+/* Corners in order around the quad, each with its own colour */
+static void emitQuad(RowWriter &w, const float p[4][3], const float c[4][3])
+{
+    static const int order[6] = { 0, 1, 2, 0, 2, 3 };
+    for(int v=0; v<6; v++)
+        for(int k=0; k<3; k++)
+        {
+            w.pos[3*(w.n+v) + k] = p[order[v]][k];
+            w.color[3*(w.n+v) + k] = c[order[v]][k];
+        }
+    w.n += 6;
+}
+
+/* A wall from x0 to x1 (or y0 to y1) standing under the tile tops, lit
+   for normal (nx, ny) and darkening towards its bottom edge */
+static void emitSide(RowWriter &w, float x0, float y0, float x1, float y1, float nx, float ny, const float base[3])
+{
+    float shade = shadeFor(nx, ny, 0);
+    const float p[4][3] = { {x0, y0, 0}, {x1, y1, 0}, {x1, y1, -0.2}, {x0, y0, -0.2} };
+    float c[4][3];
+    for(int k=0; k<3; k++)
+    {
+        c[0][k] = c[1][k] = base[k]*shade;
+        c[2][k] = c[3][k] = base[k]*shade*0.55;
+    }
+    emitQuad(w, p, c);
+}
+
+// Each top stops this far short of its cell's edges, so a dark line
+// shows between tiles, as wide as the gap between the old 0.95 tiles
+static const float topInset = 0.025;
+
+/* Mesh board row i into its ROW_VERTS range and return the vertices used.
+ *
+ * Every tile fills its whole cell, so it meets the tiles next to it in
+ * either direction flush and the walls between them are hidden; only walls
+ * facing an empty cell are made. A run of tiles in a row is one slab: a
+ * bottom quad, walls along the open parts of its sides and two end caps,
+ * and just under the tops a dark quad across the run. Each tile's top is a
+ * quad of its own, inset from the cell's edges, so the dark quad shows
+ * round it and the cells can still be counted. Tops are all lit alike, as
+ * nothing on the board stands above them to shade them. Quads are never
+ * merged across rows, which is what lets a change re-mesh only the rows
+ * around it.
+ */
+static int writeRow(BoardMesh &mesh, const PaddedLooks &looks, int i)
+{
+    RowWriter w = { &mesh.pos[3*i*ROW_VERTS], &mesh.color[3*i*ROW_VERTS], 0 };
+    float y0 = 4-i, y1 = y0 + 1;
+
+    // Per tile, whether it's fragile: the only other colour. World +x is
+    // the column to the left and +y the row above.
+    int kind[LEVEL_COLS];
+    for(int j=0; j<LEVEL_COLS; j++)
+        kind[j] = (looks[i+1][j+1] & 7) == LOOK_FRAGILE;
+    float base[2][3] = { {0.5, 0.25, 0}, {0.5, 0, 0} };     // orange, brown-red
+    float topShade = shadeFor(0, 0, 1), bottomShade = shadeFor(0, 0, -1);
+
+    for(int j=0; j<LEVEL_COLS; )
+    {
+        if(!solidAt(looks, i, j))
+        {
+            j++;
+            continue;
+        }
+        // A run of tiles, j to end-1, all flush with each other
+        int end = j+1;
+        while(end < LEVEL_COLS && solidAt(looks, i, end))
+            end++;
+        float runX0 = 7-(end-1), runX1 = 7-j + 1;
+
+        // The caps, the walls facing the rows above and below where those
+        // are open, and the bottom, split where the colour changes
+        emitSide(w, runX1, y0, runX1, y1, 1, 0, base[kind[j]]);
+        emitSide(w, runX0, y1, runX0, y0, -1, 0, base[kind[end-1]]);
+        for(int side=0; side<2; side++)
+        {
+            int dr = side ? 1 : -1;
+            float y = side ? y0 : y1;
+            for(int a=j; a<end; )
+            {
+                int b = a+1;
+                while(b < end && kind[b] == kind[a] && solidAt(looks, i+dr, b) == solidAt(looks, i+dr, a))
+                    b++;
+                if(!solidAt(looks, i+dr, a))
+                    emitSide(w, 7-a + 1, y, 7-(b-1), y, 0, side ? -1 : 1, base[kind[a]]);
+                a = b;
+            }
+        }
+        for(int a=j; a<end; )
+        {
+            int b = a+1;
+            while(b < end && kind[b] == kind[a])
+                b++;
+            float x1 = 7-a + 1, x0 = 7-(b-1);
+            const float p[4][3] = { {x0, y0, -0.2}, {x1, y0, -0.2}, {x1, y1, -0.2}, {x0, y1, -0.2} };
+            float c[4][3];
+            for(int v=0; v<4; v++)
+                for(int k=0; k<3; k++)
+                    c[v][k] = base[kind[a]][k]*bottomShade*0.3;
+            emitQuad(w, p, c);
+            a = b;
+        }
+
+        // The lines between the tops, then the tops
+        {
+            const float p[4][3] = { {runX0, y0, -0.01}, {runX1, y0, -0.01}, {runX1, y1, -0.01}, {runX0, y1, -0.01} };
+            const float c[4][3] = { {0,0,0}, {0,0,0}, {0,0,0}, {0,0,0} };
+            emitQuad(w, p, c);
+        }
+        for(int a=j; a<end; a++)
+        {
+            float x0 = 7-a + topInset, x1 = 7-a + 1 - topInset;
+            const float p[4][3] = { {x0, y0 + topInset, 0}, {x1, y0 + topInset, 0}, {x1, y1 - topInset, 0}, {x0, y1 - topInset, 0} };
+            float c[4][3];
+            for(int v=0; v<4; v++)
+                for(int k=0; k<3; k++)
+                    c[v][k] = base[kind[a]][k]*topShade;
+            emitQuad(w, p, c);
+        }
+        j = end;
+    }
+
+    for(int j=0; j<LEVEL_COLS; j++)
+    {
+        int look = looks[i+1][j+1];
+        const float *marker = NULL;
+        int markerVerts = 0;
+        if((look & 7) == LOOK_HSWITCH)
+        {
+            marker = hardSwitchVertices;
+            markerVerts = 6;
+        }
+        else if((look & 7) == LOOK_SSWITCH)
+        {
+            marker = softSwitchVertices;
+            markerVerts = 3;
+        }
+        const float *tint = markerColors[(look >> 3) & (MAX_BRIDGE_GROUPS-1)];
+        for(int v=0; v<markerVerts; v++, w.n++)
+        {
+            w.pos[3*w.n] = marker[3*v] + 7-j;
+            w.pos[3*w.n+1] = marker[3*v+1] + y0;
+            w.pos[3*w.n+2] = marker[3*v+2];
+            for(int c=0; c<3; c++)
+                w.color[3*w.n+c] = tint[c];
+        }
+    }
+    return w.n;
+}
+
+/* Threads that help bake a whole board: started the first time one is
+ * baked and kept for good, so later levels start no threads. One board is
+ * baked at a time; anyone who finds the pool busy, like a world loader
+ * while the game starts a level, bakes on its own thread instead. The
+ * caller bakes rows too, and returns once every helper has finished.
+ */
+struct BakePool {
+    mutex job;                  // held by the caller whose board is baking
+    mutex lock;                 // guards everything below
+    condition_variable wake, finished;
+    int helpers;
+    unsigned generation;        // bumped for every board
+    int busy;                   // helpers not done with this board yet
+    BoardMesh *mesh;
+    const PaddedLooks *looks;
+    const vector<int> *rows;
+    atomic<size_t> next;
+};
+
+static void bakeRows(BakePool *p)
+{
+    for(size_t k; (k = p->next++) < p->rows->size(); )
+    {
+        int row = (*p->rows)[k];
+        p->mesh->rowVerts[row] = writeRow(*p->mesh, *p->looks, row);
+    }
+}
+
+static void bakeLoop(BakePool *p)
+{
+    unique_lock<mutex> lock(p->lock);
+    for(unsigned seen = 0; ; )
+    {
+        p->wake.wait(lock, [&]() { return p->generation != seen; });
+        seen = p->generation;
+        lock.unlock();
+        bakeRows(p);
+        lock.lock();
+        if(--p->busy == 0)
+            p->finished.notify_one();
+    }
+}
+
+/* The pool, or NULL on one core */
+static BakePool *bakePool()
+{
+    static BakePool *pool = []() -> BakePool* {
+        int helpers = min((int)thread::hardware_concurrency(), LEVEL_ROWS) - 1;
+        if(helpers < 1)
+            return NULL;
+        // Lives as long as the process; the helpers just sleep at exit
+        BakePool *p = new BakePool;
+        p->helpers = helpers;
+        p->generation = 0;
+        p->busy = 0;
+        for(int t=0; t<helpers; t++)
+            thread(bakeLoop, p).detach();
+        return p;
+    }();
+    return pool;
+}
+
+/* The bridge cells of s, by group */
+static void findBridges(const GameState *s, BoardMesh &mesh)
+{
+    mesh.bridgeCount = 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+        {
+            int tile = s->level[i][j];
+            int bridge = tile == T_HBRIDGE || tile == T_SBRIDGE;
+            mesh.bridgeGroup[i][j] = bridge ? 1 + s->group[i][j] : 0;
+            if(bridge)
+                mesh.bridgeCells[mesh.bridgeCount++] = i*LEVEL_COLS + j;
+        }
+    mesh.bridgesStale = 0;
+}
+
+void syncBoardMesh(const GameState *s, BoardMesh &mesh, vector<int> &changed)
+{
+    changed.clear();
+    if(s->bridges != mesh.bridges || mesh.bridgesStale)
+    {
+        if(mesh.bridgesStale)
+            findBridges(s, mesh);
+        // Only the bridges of the groups that flipped
+        unsigned flipped = s->bridges ^ mesh.bridges;
+        for(int k=0; k<mesh.bridgeCount; k++)
+        {
+            int cell = mesh.bridgeCells[k], i = cell / LEVEL_COLS, j = cell % LEVEL_COLS;
+            if((flipped >> (mesh.bridgeGroup[i][j] - 1)) & 1)
+                markBoardCell(mesh, i, j);
+        }
+        mesh.bridges = s->bridges;
+    }
+    // Most frames nothing is marked and this is all there is
+    if(!mesh.dirtyCount)
+        return;
+
+    // A row's mesh depends on the looks of its own row and the two next to it
+    int dirty[LEVEL_ROWS] = { 0 };
+    int any = 0;
+    for(int k=0; k<mesh.dirtyCount; k++)
+    {
+        int i = mesh.dirtyCells[k] / LEVEL_COLS, j = mesh.dirtyCells[k] % LEVEL_COLS;
+        mesh.dirty[i][j] = 0;
+        // A cell that has become a bridge, or moved to another group,
+        // isn't in the list yet
+        int tile = s->level[i][j];
+        if((tile == T_HBRIDGE || tile == T_SBRIDGE) != (mesh.bridgeGroup[i][j] != 0) ||
+           (mesh.bridgeGroup[i][j] && mesh.bridgeGroup[i][j] != 1 + s->group[i][j]))
+            mesh.bridgesStale = 1;
+        // Switch markers are coloured by group, so a switch's group
+        // is part of its look
+        int look = cellLook(s, i, j);
+        if(look == LOOK_HSWITCH || look == LOOK_SSWITCH)
+            look |= s->group[i][j] << 3;
+        if(look == mesh.look[i][j])
+            continue;
+        mesh.look[i][j] = look;
+        for(int r=max(0, i-1); r<=min(LEVEL_ROWS-1, i+1); r++)
+            dirty[r] = any = 1;
+    }
+    mesh.dirtyCount = 0;
+    if(!any)
+        return;
+
+    PaddedLooks looks;
+    memset(looks, 0, sizeof(looks));
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            looks[i+1][j+1] = mesh.look[i][j];
+    for(int i=0; i<LEVEL_ROWS; i++)
+        if(dirty[i])
+            changed.push_back(i);
+
+    // A whole new level is meshed with the pool's help, the odd toggled
+    // bridge or broken tile right here
+    BakePool *p = changed.size() * LEVEL_COLS / bakePerThread >= 2 ? bakePool() : NULL;
+    unique_lock<mutex> job;
+    if(p)
+        job = unique_lock<mutex>(p->job, try_to_lock);
+    if(!p || !job.owns_lock())
+    {
+        for(int row : changed)
+            mesh.rowVerts[row] = writeRow(mesh, looks, row);
+        return;
+    }
+    {
+        lock_guard<mutex> guard(p->lock);
+        p->mesh = &mesh;
+        p->looks = &looks;
+        p->rows = &changed;
+        p->next = 0;
+        p->busy = p->helpers;
+        p->generation++;
+    }
+    p->wake.notify_all();
+    bakeRows(p);
+    unique_lock<mutex> lock(p->lock);
+    p->finished.wait(lock, [&]() { return p->busy == 0; });
+}
@@ -0,0 +1,64 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+
+#include "rules.h"
+
+/* What a board cell shows. Bridges show as tiles while their group is
+   out; the goal is a hole and shows nothing. */
+#define LOOK_NONE     0
+#define LOOK_TILE     1
+#define LOOK_FRAGILE  2
+#define LOOK_HSWITCH  3   // tile with a square marker
+#define LOOK_SSWITCH  4   // tile with a triangle marker
+
+int cellLook(const GameState *s, int row, int col);
+
+/* The whole board as one triangle list, with a fixed range of ROW_VERTS
+   vertices per board row starting at vertex i*ROW_VERTS. A row uses the
+   first rowVerts[i] of them, so it can be meshed again on its own and
+   drawn with one glMultiDrawArrays() range per row. Every face of a row
+   comes from one of its cells and no cell gives more than 48 vertices (a
+   top, the dark quad under it, a bottom, four walls and a marker), so a
+   row always fits. */
+#define ROW_VERTS (LEVEL_COLS*48)
+#define BOARD_VERTS (LEVEL_ROWS*ROW_VERTS)
+
+struct BoardMesh {
+    std::vector<float> pos, color;          // 3 floats per vertex
+    int look[LEVEL_ROWS][LEVEL_COLS];       // what each cell shows
+    int rowVerts[LEVEL_ROWS];               // vertices used in each row
+    // Cells to look at on the next syncBoardMesh(), see markBoardCell()
+    unsigned char dirty[LEVEL_ROWS][LEVEL_COLS];
+    short dirtyCells[LEVEL_ROWS*LEVEL_COLS];
+    int dirtyCount;
+    // The bridge cells and their groups, for finding what a switch moved
+    unsigned bridges;                       // as last synced
+    unsigned char bridgeGroup[LEVEL_ROWS][LEVEL_COLS];  // 1 + group, 0 if none
+    short bridgeCells[LEVEL_ROWS*LEVEL_COLS];
+    int bridgeCount, bridgesStale;
+};
+
+/* An empty mesh; the first syncBoardMesh() fills in every row */
+void initBoardMesh(BoardMesh &mesh);
+
+/* Only cells marked since the last sync are looked at, so a frame where
+   nothing changed does no per-cell work. Bridges are found from the
+   switch state by syncBoardMesh() itself; whatever else changes a tile
+   marks it: the block's cells after a move, as that is where a fragile
+   tile breaks, the editor's cell, and the whole board for a new level. */
+void markBoardCell(BoardMesh &mesh, int row, int col);
+void markBlockCells(BoardMesh &mesh, const GameState *s);
+void markBoardAll(BoardMesh &mesh);
+
+/* Tiles in a row that touch are merged into one slab with no walls
+   between them (see writeRow() in scene.cpp). Directional light on each
+   face is baked into the vertex colours. Walls are only made towards empty
+   cells, so a row is meshed again when a look changes in it or in the row
+   above or below. The rows meshed are listed, ascending, in changed. */
+void syncBoardMesh(const GameState *s, BoardMesh &mesh, std::vector<int> &changed);
+
+int boardTriangles(const BoardMesh &mesh);
+
+#endif
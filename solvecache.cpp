@@ -0,0 +1,233 @@
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <ctime>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "solvecache.h"
+
+using namespace std;
+
+/* An entry file is this header, then dist (distCount shorts), then the
+   path (pathLen chars) */
+struct CacheHeader {
+    char magic[4];
+    int32_t rules;
+    uint64_t key;
+    int32_t moves, states, transitions, falls, deadEnds;
+    int32_t distCount, pathLen;
+};
+
+static const char cacheMagic[4] = { 'B', 'X', 'S', 'C' };
+// Stores between two size checks of the cache directory
+static const int evictEvery = 64;
+
+static int cacheEnabled = 1;
+static mutex evictLock;
+static int storesSinceEvict = evictEvery;
+
+void disableSolveCache()
+{
+    cacheEnabled = 0;
+}
+
+uint64_t levelHash(const GameState *s)
+{
+    // FNV-1a over the rules version, the tiles with their groups and the
+    // start key
+    uint64_t h = 1469598103934665603ULL;
+    int words[LEVEL_ROWS*LEVEL_COLS + 2];
+    int n = 0;
+    words[n++] = RULES_VERSION;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            words[n++] = s->level[i][j] | s->group[i][j] << 8;
+    words[n++] = stateKey(s);
+    const unsigned char *bytes = (const unsigned char *)words;
+    for(size_t k=0; k<sizeof(words); k++)
+    {
+        h ^= bytes[k];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void makeDirs(const string &path)
+{
+    for(size_t at = 1; at <= path.size(); at++)
+        if(at == path.size() || path[at] == '/')
+            mkdir(path.substr(0, at).c_str(), 0755);
+}
+
+static const string &cacheDir()
+{
+    static string dir;
+    static once_flag found;
+    call_once(found, []() {
+        const char *env;
+        if((env = getenv("BLOX_CACHE")) && *env)
+            dir = env;
+        else if((env = getenv("XDG_CACHE_HOME")) && *env)
+            dir = string(env) + "/bloxorz";
+        else if((env = getenv("HOME")) && *env)
+            dir = string(env) + "/.cache/bloxorz";
+        else
+            dir = ".bloxcache";
+        makeDirs(dir);
+    });
+    return dir;
+}
+
+static long long cacheCap()
+{
+    const char *env = getenv("BLOX_CACHE_MB");
+    long long mb = env ? atoll(env) : 64;
+    return (mb > 0 ? mb : 64) << 20;
+}
+
+static string entryPath(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+    return cacheDir() + name;
+}
+
+static int lookup(uint64_t key, int states, SolveResult *out, int withDist)
+{
+    string path = entryPath(key);
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return 0;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(CacheHeader))
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        return 0;
+
+    const CacheHeader *h = (const CacheHeader *)map;
+    int hit = !memcmp(h->magic, cacheMagic, 4) && h->rules == RULES_VERSION && h->key == key &&
+              (h->distCount == 0 || h->distCount == states) && h->pathLen >= 0 &&
+              st.st_size == (off_t)(sizeof(CacheHeader) + h->distCount*sizeof(short) + h->pathLen) &&
+              (h->distCount || !withDist);
+    if(hit)
+    {
+        const short *dist = (const short *)(h + 1);
+        const char *pathChars = (const char *)(dist + h->distCount);
+        out->moves = h->moves;
+        out->states = h->states;
+        out->transitions = h->transitions;
+        out->falls = h->falls;
+        out->deadEnds = h->deadEnds;
+        out->path.assign(pathChars, h->pathLen);
+        if(withDist)
+            out->dist.assign(dist, dist + h->distCount);
+        else
+            out->dist.clear();
+    }
+    munmap(map, st.st_size);
+    // Mark it recently used; a minute is close enough for the LRU order
+    if(hit && st.st_mtime < time(NULL) - 60)
+        utimensat(AT_FDCWD, path.c_str(), NULL, 0);
+    return hit;
+}
+
+/* Drop the least recently used entries until the cache fits its cap */
+static void evict()
+{
+    struct Entry { string path; time_t used; long long size; };
+    vector<Entry> entries;
+    long long total = 0;
+    DIR *d = opendir(cacheDir().c_str());
+    if(!d)
+        return;
+    while(struct dirent *e = readdir(d))
+    {
+        string name = e->d_name;
+        if(name.size() < 4 || name.compare(name.size()-4, 4, ".bin"))
+            continue;
+        Entry entry;
+        entry.path = cacheDir() + "/" + name;
+        struct stat st;
+        if(stat(entry.path.c_str(), &st) != 0)
+            continue;
+        entry.used = st.st_mtime;
+        entry.size = st.st_size;
+        total += entry.size;
+        entries.push_back(entry);
+    }
+    closedir(d);
+
+    long long cap = cacheCap();
+    if(total <= cap)
+        return;
+    sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.used < b.used; });
+    for(size_t k=0; k<entries.size() && total > cap; k++)
+        if(unlink(entries[k].path.c_str()) == 0)
+            total -= entries[k].size;
+}
+
+static void store(uint64_t key, const SolveResult *r)
+{
+    CacheHeader h;
+    memcpy(h.magic, cacheMagic, 4);
+    h.rules = RULES_VERSION;
+    h.key = key;
+    h.moves = r->moves;
+    h.states = r->states;
+    h.transitions = r->transitions;
+    h.falls = r->falls;
+    h.deadEnds = r->deadEnds;
+    h.distCount = r->dist.size();
+    h.pathLen = r->path.size();
+
+    // Write under a temporary name and rename, so readers never see half a file
+    string path = entryPath(key);
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%d.%zx.tmp", (int)getpid(), hash<thread::id>()(this_thread::get_id()));
+    string tmp = path + suffix;
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if(!f)
+        return;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    if(h.distCount)
+        ok &= fwrite(&r->dist[0], sizeof(short), h.distCount, f) == (size_t)h.distCount;
+    ok &= fwrite(r->path.data(), 1, h.pathLen, f) == (size_t)h.pathLen;
+    ok &= fclose(f) == 0;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+        return;
+    }
+
+    lock_guard<mutex> guard(evictLock);
+    if(++storesSinceEvict >= evictEvery)
+    {
+        storesSinceEvict = 0;
+        evict();
+    }
+}
+
+int cachedSolve(const GameState *s, SolveResult *out, int withDist, const atomic<int> *cancel)
+{
+    if(!cacheEnabled)
+        return solveLevel(s, out, withDist, cancel);
+    uint64_t key = levelHash(s);
+    if(lookup(key, stateCount(s), out, withDist))
+        return out->moves;
+    solveLevel(s, out, withDist, cancel);
+    if(!cancel || !cancel->load())
+        store(key, out);
+    return out->moves;
+}
@@ -0,0 +1,28 @@
+#ifndef SOLVECACHE_H
+#define SOLVECACHE_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "solver.h"
+
+/* Solver results kept on disk, one file per level named after
+   levelHash(), so an unchanged level is never solved twice. Files are
+   read with mmap and hold the SolveResult fields as they are in memory.
+
+   The cache lives in $BLOX_CACHE, or else $XDG_CACHE_HOME/bloxorz or
+   ~/.cache/bloxorz. Once it grows past $BLOX_CACHE_MB megabytes (64 by
+   default) the least recently used entries are removed. */
+
+/* Hash of the board and its bridge groups, the start position and
+   RULES_VERSION */
+uint64_t levelHash(const GameState *s);
+
+/* solveLevel() through the cache. A hit without a distance table doesn't
+   count when withDist is set. Cancelled searches are not stored. */
+int cachedSolve(const GameState *s, SolveResult *out, int withDist=1, const std::atomic<int> *cancel=NULL);
+
+/* Make cachedSolve() always solve, and store nothing */
+void disableSolveCache();
+
+#endif
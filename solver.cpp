@@ -0,0 +1,134 @@
+#include <cstring>
+#include <algorithm>
+
+#include "solver.h"
+
+using namespace std;
+
+static const char moveKeys[] = "UDRL";
+
+void setState(GameState *s, int key)
+{
+    int pose = key >> s->groups;
+    s->bridges = key & ((1 << s->groups) - 1);
+    s->currblock = pose % 3 + 1;
+    pose /= 3;
+    s->blockTransX = 7 - pose % LEVEL_COLS;
+    s->blockTransY = 4 - pose / LEVEL_COLS;
+    s->endGame = s->win = 0;
+}
+
+int solveLevel(const GameState *s, SolveResult *out, int withDist, const atomic<int> *cancel)
+{
+    static const int unseen = -1;
+    int count = stateCount(s);
+    vector<int> parent(count, unseen);
+    vector<char> via(count, 0);
+    vector<int> queue;
+    // live -> live edges, kept for the backwards pass
+    vector<int> edgeFrom, edgeTo;
+    vector<int> winners;
+    queue.reserve(count);
+
+    out->moves = -1;
+    out->path.clear();
+    out->states = out->transitions = out->falls = out->deadEnds = 0;
+
+    GameState g = *s;
+    g.endGame = g.win = 0;
+    int start = stateKey(&g);
+    parent[start] = start;
+    queue.push_back(start);
+
+    int goal = -1;
+    char goalMove = 0;
+    for(size_t head = 0; head < queue.size(); head++)
+    {
+        if(cancel && cancel->load(memory_order_relaxed))
+            return -1;
+        int key = queue[head];
+        for(int m = 0; m < 4; m++)
+        {
+            GameState next = *s;
+            setState(&next, key);
+            moveKey(&next, moveKeys[m]);
+            out->transitions++;
+            if(next.win)
+            {
+                if(goal < 0)
+                {
+                    goal = key;
+                    goalMove = moveKeys[m];
+                }
+                winners.push_back(key);
+                continue;
+            }
+            if(next.endGame)
+            {
+                out->falls++;
+                continue;
+            }
+            int to = stateKey(&next);
+            if(withDist)
+            {
+                edgeFrom.push_back(key);
+                edgeTo.push_back(to);
+            }
+            if(parent[to] == unseen)
+            {
+                parent[to] = key;
+                via[to] = moveKeys[m];
+                queue.push_back(to);
+            }
+        }
+    }
+    out->states = queue.size();
+
+    if(goal >= 0)
+    {
+        out->path = goalMove;
+        for(int key = goal; key != start; key = parent[key])
+            out->path += via[key];
+        reverse(out->path.begin(), out->path.end());
+        out->moves = out->path.size();
+    }
+
+    if(!withDist)
+    {
+        out->dist.clear();
+        return out->moves;
+    }
+
+    // Backwards breadth-first pass from every position one move from the goal
+    out->dist.assign(count, -1);
+    vector<int> first(count + 1, 0), into(edgeTo.size());
+    for(size_t e = 0; e < edgeTo.size(); e++)
+        first[edgeTo[e] + 1]++;
+    for(int k = 0; k < count; k++)
+        first[k + 1] += first[k];
+    vector<int> fill(first.begin(), first.end() - 1);
+    for(size_t e = 0; e < edgeTo.size(); e++)
+        into[fill[edgeTo[e]]++] = edgeFrom[e];
+
+    queue.clear();
+    for(int key : winners)
+        if(out->dist[key] < 0)
+        {
+            out->dist[key] = 1;
+            queue.push_back(key);
+        }
+    for(size_t head = 0; head < queue.size(); head++)
+    {
+        int key = queue[head];
+        for(int e = first[key]; e < first[key + 1]; e++)
+            if(out->dist[into[e]] < 0)
+            {
+                out->dist[into[e]] = out->dist[key] + 1;
+                queue.push_back(into[e]);
+            }
+    }
+    for(int key = 0; key < count; key++)
+        if(parent[key] != unseen && out->dist[key] < 0)
+            out->deadEnds++;
+    return out->moves;
+}
@@ -0,0 +1,45 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "rules.h"
+
+/* A live (not fallen, not won) position is the block pose plus which
+   bridge groups are out: fragile tiles only break under a block that is
+   falling, so the board itself never differs between live positions. */
+#define POSE_COUNT  (LEVEL_ROWS*LEVEL_COLS*3)
+
+/* Number of state keys for the level of s */
+inline int stateCount(const GameState *s)
+{
+    return POSE_COUNT << s->groups;
+}
+
+inline int stateKey(const GameState *s)
+{
+    int pose = (blockRow(s)*LEVEL_COLS + blockCol(s))*3 + s->currblock-1;
+    return pose << s->groups | s->bridges;
+}
+
+/* Put the block of s into the position described by key */
+void setState(GameState *s, int key);
+
+struct SolveResult {
+    int moves;                 // optimal move count, -1 when unsolvable
+    std::string path;          // an optimal solution as moveKey() keys
+    int states;                // live positions reachable from the start
+    int transitions;           // moves tried from reachable positions
+    int falls;                 // ... of which ended in a fall
+    int deadEnds;              // reachable positions the goal can't be reached from
+    std::vector<short> dist;   // moves to the goal for each of the stateCount() keys, -1 if none
+};
+
+/* Breadth-first search from the start position of s. The distance table is
+   only filled in when withDist is set. The search gives up, returning -1,
+   as soon as *cancel becomes non-zero. Returns out->moves. */
+int solveLevel(const GameState *s, SolveResult *out, int withDist=1, const std::atomic<int> *cancel=NULL);
+
+#endif
@@ -0,0 +1,414 @@
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "spectate.h"
+
+using namespace std;
+
+/* A client further behind than this is dropped rather than buffered */
+#define MAX_PENDING (256*1024)
+
+/**************************
+ * Encoding               *
+ **************************/
+
+static void put32(string &out, unsigned v)
+{
+    for(int i=0; i<4; i++)
+        out += (char)((v >> (8*i)) & 0xff);
+}
+
+static unsigned get32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+static void putVarint(string &out, unsigned v)
+{
+    while(v >= 0x80)
+    {
+        out += (char)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+static int flagsOf(const GameState *s)
+{
+    return s->endGame | (s->win << 1);
+}
+
+/* A cell on the wire: tile code in the low nibble, bridge group above */
+static int cellCode(const GameState *s, int i, int j)
+{
+    return s->level[i][j] | (s->group[i][j] << 4);
+}
+
+/* Frame header with the length patched in once the payload is written */
+static size_t beginFrame(string &out, int type)
+{
+    out += (char)type;
+    out.append(2, '\0');
+    return out.size();
+}
+
+static void endFrame(string &out, size_t start)
+{
+    size_t len = out.size() - start;
+    out[start-2] = len & 0xff;
+    out[start-1] = (len >> 8) & 0xff;
+}
+
+void encodeSnapshot(string &out, unsigned version, const GameState *s)
+{
+    size_t start = beginFrame(out, SPECTATE_SNAPSHOT);
+    put32(out, version);
+    out += (char)blockRow(s);
+    out += (char)blockCol(s);
+    out += (char)s->currblock;
+    out += (char)flagsOf(s);
+    out += (char)s->bridges;
+    put32(out, s->numOfSteps);
+    out += (char)LEVEL_ROWS;
+    out += (char)LEVEL_COLS;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            out += (char)cellCode(s, i, j);
+    endFrame(out, start);
+}
+
+int encodeDelta(string &out, unsigned version, const GameState *from, const GameState *to)
+{
+    int mask = 0;
+    if(blockRow(from) != blockRow(to) || blockCol(from) != blockCol(to) || from->currblock != to->currblock)
+        mask |= DELTA_POSE;
+    if(flagsOf(from) != flagsOf(to) || from->bridges != to->bridges)
+        mask |= DELTA_FLAGS;
+    if(from->numOfSteps != to->numOfSteps)
+        mask |= DELTA_STEPS;
+    int cells = 0;
+    for(int i=0; i<LEVEL_ROWS; i++)
+        for(int j=0; j<LEVEL_COLS; j++)
+            cells += cellCode(from, i, j) != cellCode(to, i, j);
+    if(cells)
+        mask |= DELTA_CELLS;
+    if(!mask)
+        return 0;
+    // A new level is cheaper to send whole
+    if(cells > 32)
+    {
+        encodeSnapshot(out, version, to);
+        return 1;
+    }
+
+    size_t start = beginFrame(out, SPECTATE_DELTA);
+    put32(out, version);
+    out += (char)mask;
+    if(mask & DELTA_POSE)
+    {
+        out += (char)blockRow(to);
+        out += (char)blockCol(to);
+        out += (char)to->currblock;
+    }
+    if(mask & DELTA_FLAGS)
+    {
+        out += (char)flagsOf(to);
+        out += (char)to->bridges;
+    }
+    if(mask & DELTA_STEPS)
+        putVarint(out, to->numOfSteps);
+    if(mask & DELTA_CELLS)
+    {
+        out += (char)cells;
+        for(int i=0; i<LEVEL_ROWS; i++)
+            for(int j=0; j<LEVEL_COLS; j++)
+                if(cellCode(from, i, j) != cellCode(to, i, j))
+                {
+                    out += (char)(i*LEVEL_COLS + j);
+                    out += (char)cellCode(to, i, j);
+                }
+    }
+    endFrame(out, start);
+    return 1;
+}
+
+static void setPose(GameState *s, int row, int col, int currblock)
+{
+    s->blockTransX = 7 - col;
+    s->blockTransY = 4 - row;
+    s->currblock = currblock;
+}
+
+static void setFlags(GameState *s, int flags, int bridges)
+{
+    s->endGame = flags & 1;
+    s->win = (flags >> 1) & 1;
+    s->bridges = bridges;
+}
+
+static void setCell(GameState *s, int i, int j, int code)
+{
+    s->level[i][j] = code & 15;
+    s->group[i][j] = code >> 4;
+}
+
+int applyFrame(GameState *s, unsigned *version, int type, const unsigned char *p, int len)
+{
+    const unsigned char *end = p + len;
+    if(len < 4)
+        return 0;
+    *version = get32(p);
+    p += 4;
+
+    if(type == SPECTATE_SNAPSHOT)
+    {
+        if(end - p < 11)
+            return 0;
+        int rows = p[9], cols = p[10];
+        if(rows != LEVEL_ROWS || cols != LEVEL_COLS || end - p < 11 + rows*cols)
+            return 0;
+        setPose(s, (signed char)p[0], (signed char)p[1], p[2]);
+        setFlags(s, p[3], p[4]);
+        s->numOfSteps = get32(p + 5);
+        p += 11;
+        for(int i=0; i<rows; i++)
+            for(int j=0; j<cols; j++)
+                setCell(s, i, j, *p++);
+        countGroups(s);
+        return 1;
+    }
+    if(type != SPECTATE_DELTA || p >= end)
+        return 0;
+
+    int mask = *p++;
+    if(mask & DELTA_POSE)
+    {
+        if(end - p < 3)
+            return 0;
+        setPose(s, (signed char)p[0], (signed char)p[1], p[2]);
+        p += 3;
+    }
+    if(mask & DELTA_FLAGS)
+    {
+        if(end - p < 2)
+            return 0;
+        setFlags(s, p[0], p[1]);
+        p += 2;
+    }
+    if(mask & DELTA_STEPS)
+    {
+        unsigned v = 0;
+        int shift = 0;
+        do {
+            if(p >= end || shift > 28)
+                return 0;
+            v |= (*p & 0x7f) << shift;
+            shift += 7;
+        } while(*p++ & 0x80);
+        s->numOfSteps = v;
+    }
+    if(mask & DELTA_CELLS)
+    {
+        if(p >= end)
+            return 0;
+        int n = *p++;
+        if(end - p < 2*n)
+            return 0;
+        for(int k=0; k<n; k++, p += 2)
+            if(p[0] < LEVEL_ROWS*LEVEL_COLS)
+                setCell(s, p[0] / LEVEL_COLS, p[0] % LEVEL_COLS, p[1]);
+        countGroups(s);
+    }
+    return 1;
+}
+
+/**************************
+ * Server                 *
+ **************************/
+
+struct Client {
+    int fd;
+    int synced;     // has had a snapshot, so deltas make sense to it
+    string pending;
+};
+
+static mutex publishLock;
+static GameState published;
+static unsigned publishedVersion = 0;
+static atomic<int> serving(0);
+static thread server;
+static int listenFd = -1;
+
+void spectatePublish(const GameState *s)
+{
+    if(!serving)
+        return;
+    lock_guard<mutex> guard(publishLock);
+    published = *s;
+    publishedVersion++;
+}
+
+static void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+/* Send what the socket takes right now; returns 0 if the client is gone */
+static int flush(Client &c)
+{
+    while(!c.pending.empty())
+    {
+        ssize_t n = send(c.fd, c.pending.data(), c.pending.size(), MSG_NOSIGNAL);
+        if(n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        c.pending.erase(0, n);
+    }
+    return 1;
+}
+
+static void serve(int tickMs)
+{
+    vector<Client> clients;
+    vector<pollfd> fds;
+    GameState sent;
+    unsigned sentVersion = 0;
+    int haveState = 0;
+    string frame;
+    auto nextTick = chrono::steady_clock::now();
+
+    while(serving)
+    {
+        auto now = chrono::steady_clock::now();
+        if(now >= nextTick)
+        {
+            nextTick = now + chrono::milliseconds(tickMs);
+            GameState latest;
+            unsigned version;
+            {
+                lock_guard<mutex> guard(publishLock);
+                latest = published;
+                version = publishedVersion;
+            }
+            // Everything published since the last tick goes out as one delta
+            if(version != sentVersion)
+            {
+                frame.clear();
+                if(haveState && encodeDelta(frame, version, &sent, &latest))
+                    for(Client &c : clients)
+                        if(c.synced)
+                            c.pending += frame;
+                sent = latest;
+                sentVersion = version;
+                haveState = 1;
+            }
+            for(Client &c : clients)
+                if(!c.synced && haveState)
+                {
+                    encodeSnapshot(c.pending, sentVersion, &sent);
+                    c.synced = 1;
+                }
+        }
+
+        fds.clear();
+        pollfd l = { listenFd, POLLIN, 0 };
+        fds.push_back(l);
+        for(Client &c : clients)
+        {
+            pollfd p = { c.fd, (short)(POLLIN | (c.pending.empty() ? 0 : POLLOUT)), 0 };
+            fds.push_back(p);
+        }
+        int wait = chrono::duration_cast<chrono::milliseconds>(nextTick - chrono::steady_clock::now()).count();
+        poll(&fds[0], fds.size(), max(wait, 0));
+
+        if(fds[0].revents & POLLIN)
+        {
+            int fd;
+            while((fd = accept(listenFd, NULL, NULL)) >= 0)
+            {
+                setNonBlocking(fd);
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                Client c;
+                c.fd = fd;
+                c.synced = haveState;
+                if(haveState)
+                    encodeSnapshot(c.pending, sentVersion, &sent);
+                clients.push_back(c);
+            }
+        }
+
+        for(size_t k = clients.size(); k-- > 0; )
+        {
+            Client &c = clients[k];
+            short ev = fds.size() > k+1 ? fds[k+1].revents : 0;
+            int alive = 1;
+            if(ev & (POLLIN | POLLHUP | POLLERR))
+            {
+                // Spectators have nothing to say; anything read is dropped
+                char buf[256];
+                ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+                if(n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+                    alive = 0;
+            }
+            if(alive)
+                alive = flush(c) && c.pending.size() <= MAX_PENDING;
+            if(!alive)
+            {
+                close(c.fd);
+                clients.erase(clients.begin() + k);
+            }
+        }
+    }
+
+    for(Client &c : clients)
+        close(c.fd);
+}
+
+int spectateStart(int port, int tickMs)
+{
+    if(serving)
+        return 1;
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if(listenFd < 0)
+        return 0;
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0)
+    {
+        close(listenFd);
+        listenFd = -1;
+        return 0;
+    }
+    setNonBlocking(listenFd);
+    serving = 1;
+    server = thread(serve, tickMs);
+    return 1;
+}
+
+void spectateStop()
+{
+    if(!serving)
+        return;
+    serving = 0;
+    server.join();
+    close(listenFd);
+    listenFd = -1;
+}
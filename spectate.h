@@ -0,0 +1,47 @@
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#include <string>
+
+#include "rules.h"
+
+/* Spectator streaming over TCP.
+ *
+ * The game publishes its state with spectatePublish() after every change;
+ * a server thread sends each new client a full snapshot and then, once per
+ * network tick, one delta holding only what changed since the last tick.
+ * The game thread never touches a socket.
+ *
+ * Every frame is a 1 byte type and a 2 byte little-endian payload length,
+ * followed by the payload; all payloads start with a 4 byte version.
+ *   SNAPSHOT  row, col, currblock, flags, bridges, steps (4 bytes), rows,
+ *             cols and rows*cols cell codes
+ *   DELTA     a mask byte, then for each set bit in order: pose (row, col,
+ *             currblock), flags and bridges, steps (varint), changed cells
+ *             (count, then cell index and cell code for each)
+ * flags holds endGame and win in bits 0-1, bridges is GameState::bridges
+ * and a cell code is the tile code plus 16 times the cell's bridge group.
+ */
+
+#define SPECTATE_SNAPSHOT 1
+#define SPECTATE_DELTA    2
+
+#define DELTA_POSE  0x01
+#define DELTA_FLAGS 0x02
+#define DELTA_STEPS 0x04
+#define DELTA_CELLS 0x08
+
+/* Start serving on port with a tick of tickMs. Returns 0 if the port
+   can't be opened. */
+int spectateStart(int port, int tickMs=50);
+void spectateStop();
+void spectatePublish(const GameState *s);
+
+/* Frame encoding, shared by the server and the viewer */
+void encodeSnapshot(std::string &out, unsigned version, const GameState *s);
+/* Returns 0 when nothing the spectators see has changed */
+int encodeDelta(std::string &out, unsigned version, const GameState *from, const GameState *to);
+/* Apply one frame payload to s; returns 0 on a malformed frame */
+int applyFrame(GameState *s, unsigned *version, int type, const unsigned char *p, int len);
+
+#endif
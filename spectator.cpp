@@ -0,0 +1,111 @@
+/* Headless spectator: connects to a game started with -spectate and prints
+ * every update it receives.
+ *
+ *   spectator [-q] [-n frames] [port]
+ *
+ * -q prints one status line per update instead of the whole board, -n
+ * exits after that many frames.
+ */
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "rules.h"
+#include "spectate.h"
+
+using namespace std;
+
+static int readFully(int fd, unsigned char *buf, int len)
+{
+    while(len > 0)
+    {
+        ssize_t n = read(fd, buf, len);
+        if(n <= 0)
+            return 0;
+        buf += n;
+        len -= n;
+    }
+    return 1;
+}
+
+static void printState(const GameState *s, unsigned version, int type, int bytes, int quiet)
+{
+    static const char *poses[] = { "?", "standing", "along y", "along x" };
+    printf("v%u %s %dB steps %d block (%d,%d) %s bridges %#x%s\n", version,
+           type == SPECTATE_SNAPSHOT ? "snapshot" : "delta", bytes, s->numOfSteps,
+           blockRow(s), blockCol(s), poses[s->currblock & 3], s->bridges,
+           s->win ? " WON" : s->endGame ? " FELL" : "");
+    if(quiet)
+        return;
+
+    // The board with the block drawn over it as #
+    string board = formatLevel(s);
+    int width = board.find('\n') + 1;
+    int r = blockRow(s), c = blockCol(s);
+    int cells[2][2] = { {r, c}, {r, c} };
+    if(s->currblock == B_ALONGY)
+        cells[1][0] = r-1;
+    else if(s->currblock == B_ALONGX)
+        cells[1][1] = c-1;
+    for(int k=0; k<2; k++)
+        if(cells[k][0] >= 0 && cells[k][0] < LEVEL_ROWS && cells[k][1] >= 0 && cells[k][1] < width-1)
+            board[cells[k][0]*width + cells[k][1]] = '#';
+    fputs(board.c_str(), stdout);
+}
+
+int main (int argc, char** argv)
+{
+    int port = 7777, quiet = 0, frames = -1;
+    for(int i=1; i<argc; i++)
+    {
+        if(!strcmp(argv[i], "-q"))
+            quiet = 1;
+        else if(!strcmp(argv[i], "-n") && i+1 < argc)
+            frames = atoi(argv[++i]);
+        else
+            port = atoi(argv[i]);
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        fprintf(stderr, "Could not connect to port %d\n", port);
+        return 2;
+    }
+
+    GameState s;
+    memset(&s, 0, sizeof(s));
+    unsigned version = 0;
+    int synced = 0;
+    unsigned char header[3], payload[65536];
+    while(frames != 0 && readFully(fd, header, 3))
+    {
+        int len = header[1] | (header[2] << 8);
+        if(!readFully(fd, payload, len))
+            break;
+        if(header[0] == SPECTATE_SNAPSHOT)
+            synced = 1;
+        if(!synced || !applyFrame(&s, &version, header[0], payload, len))
+        {
+            fprintf(stderr, "Bad frame of type %d\n", header[0]);
+            return 1;
+        }
+        printState(&s, version, header[0], len + 3, quiet);
+        fflush(stdout);
+        if(frames > 0)
+            frames--;
+    }
+    close(fd);
+    return 0;
+}
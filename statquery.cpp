@@ -0,0 +1,85 @@
+/* Prints the player statistics sample2D keeps in bloxorz.stats (or the
+ * store given with -statstore), one line per level: attempts, wins, the
+ * completion rate, the best time and steps, the mean time and percentiles
+ * of the winning times. Only the block summaries are read; -exact also
+ * reads every winning time from the columns and prints the percentiles
+ * they give, to check the summaries against.
+ *
+ *   statquery [-l level] [-exact] [store]
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+#include "statstore.h"
+
+using namespace std;
+
+static const double percentiles[] = { 50, 90, 99 };
+
+int main (int argc, char** argv)
+{
+    const char *path = "bloxorz.stats";
+    int only = 0, filtered = 0, exact = 0;
+    for(int i=1; i<argc; i++)
+    {
+        if(!strcmp(argv[i], "-l") && i+1 < argc)
+        {
+            only = atoi(argv[++i]);
+            filtered = 1;
+        }
+        else if(!strcmp(argv[i], "-exact"))
+            exact = 1;
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: statquery [-l level] [-exact] [store]\n");
+            return 2;
+        }
+        else
+            path = argv[i];
+    }
+
+    auto started = chrono::steady_clock::now();
+    map<int, LevelStats> levels;
+    if(!statsQuery(path, levels))
+    {
+        fprintf(stderr, "Could not read %s\n", path);
+        return 1;
+    }
+    double took = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    printf("%5s %9s %9s %6s %8s %6s %8s %8s %8s %8s\n", "level", "attempts", "wins", "rate", "best", "steps",
+           "mean", "p50", "p90", "p99");
+    long long attempts = 0;
+    for(auto &it : levels)
+    {
+        const LevelStats &s = it.second;
+        attempts += s.attempts;
+        if(filtered && it.first != only)
+            continue;
+        printf("%5d %9lld %9lld %5.1f%%", it.first, s.attempts, s.wins, 100.0 * s.wins / s.attempts);
+        if(!s.wins)
+        {
+            printf("\n");
+            continue;
+        }
+        printf(" %7.1fs %6u %7.1fs", s.bestMs / 1000.0, s.bestSteps, s.sumMs / s.wins / 1000);
+        for(double p : percentiles)
+            printf(" %7.1fs", statsPercentile(s, p) / 1000);
+        printf("\n");
+        if(!exact)
+            continue;
+        vector<uint32_t> ms;
+        if(!statsWinTimes(path, it.first, ms) || ms.empty())
+            continue;
+        sort(ms.begin(), ms.end());
+        printf("%5s %9s %9zu %6s %7.1fs %6s %8s", "exact", "", ms.size(), "", ms[0] / 1000.0, "", "");
+        for(double p : percentiles)
+            printf(" %7.1fs", ms[min(ms.size() - 1, (size_t)(p / 100 * ms.size()))] / 1000.0);
+        printf("\n");
+    }
+    printf("# %lld attempts at %zu levels, summed in %.2fms\n", attempts, levels.size(), 1e3 * took);
+    return 0;
+}
@@ -0,0 +1,383 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "statstore.h"
+
+using namespace std;
+
+static_assert(sizeof(StatsRow) == 16, "the tail has 16 byte rows");
+static_assert(sizeof(StatsBlock) == 56 + 4*STATS_BINS, "block headers have no padding");
+
+static const char statsMagic[4] = { 'B', 'L', 'X', 'A' };
+
+/**************************
+ * Blocks                 *
+ **************************/
+
+/* The won bits, the steps and the times after a block's header */
+static long columnBytes(uint32_t count)
+{
+    return (count + 7) / 8 + 2L*count + 4L*count;
+}
+
+int statsBin(uint32_t ms)
+{
+    if(ms < STATS_BIN_MS)
+        return 0;
+    int bin = 1 + (int)floor(STATS_BINS_PER_OCTAVE * log2((double)ms / STATS_BIN_MS));
+    return min(bin, STATS_BINS-1);
+}
+
+/* Times from binLow(b) up to binLow(b+1) go in bin b */
+static double binLow(int bin)
+{
+    return bin ? STATS_BIN_MS * exp2((bin-1) / (double)STATS_BINS_PER_OCTAVE) : 0;
+}
+
+/* The header for n rows of one level */
+static void summarize(StatsBlock &b, const StatsRow *rows, int n)
+{
+    memset(&b, 0, sizeof(b));
+    memcpy(b.magic, statsMagic, 4);
+    b.version = STATS_VERSION;
+    b.level = rows[0].level;
+    b.count = n;
+    b.bestMs = b.bestSteps = UINT32_MAX;
+    for(int i=0; i<n; i++)
+    {
+        const StatsRow &r = rows[i];
+        b.lastSeq = max(b.lastSeq, r.seq);
+        if(!r.won)
+            continue;
+        b.wins++;
+        b.bestMs = min(b.bestMs, r.ms);
+        b.bestSteps = min(b.bestSteps, (uint32_t)r.steps);
+        b.worstMs = max(b.worstMs, r.ms);
+        b.sumMs += r.ms;
+        b.sumSteps += r.steps;
+        b.bins[statsBin(r.ms)]++;
+    }
+}
+
+static int writeBlock(FILE *file, const StatsRow *rows, int n)
+{
+    StatsBlock b;
+    summarize(b, rows, n);
+    vector<unsigned char> won((n + 7) / 8);
+    vector<uint16_t> steps(n);
+    vector<uint32_t> ms(n);
+    for(int i=0; i<n; i++)
+    {
+        won[i/8] |= rows[i].won << (i%8);
+        steps[i] = rows[i].steps;
+        ms[i] = rows[i].ms;
+    }
+    return fwrite(&b, sizeof(b), 1, file) == 1 && fwrite(won.data(), 1, won.size(), file) == won.size() &&
+           fwrite(steps.data(), 2, n, file) == (size_t)n && fwrite(ms.data(), 4, n, file) == (size_t)n;
+}
+
+/* Calls each() with every whole block's header and where its columns
+   start, and returns where the last whole block ends */
+static long scanBlocks(FILE *file, const function<void(const StatsBlock&, long)> &each)
+{
+    // Only the headers are read, not the buffer's worth stdio would
+    struct stat st;
+    if(fstat(fileno(file), &st))
+        return 0;
+    long size = st.st_size, at = 0;
+    StatsBlock b;
+    while(at + (long)sizeof(b) <= size)
+    {
+        if(pread(fileno(file), &b, sizeof(b), at) != sizeof(b) || memcmp(b.magic, statsMagic, 4)
+           || b.version != STATS_VERSION || !b.count || b.count > STATS_TAIL)
+            break;
+        long end = at + sizeof(b) + columnBytes(b.count);
+        if(end > size)
+            break;
+        each(b, at + sizeof(b));
+        at = end;
+    }
+    return at;
+}
+
+/* Whether a file whose whole blocks end at end is a store: it is if there
+   are any, or if what follows starts like a block, as a store that was
+   being sealed for the first time does */
+static int isStore(FILE *file, long end)
+{
+    struct stat st;
+    if(fstat(fileno(file), &st))
+        return 0;
+    char magic[4];
+    long n = min(st.st_size - end, (long)sizeof(magic));
+    return end > 0 || n <= 0 || (pread(fileno(file), magic, n, end) == n && !memcmp(magic, statsMagic, n));
+}
+
+/* The whole rows in the tail at path that no block holds yet; *end is set
+   to where the last whole row ends */
+static void readTail(const string &path, const map<int, uint32_t> &sealed, vector<StatsRow> &rows, long *end)
+{
+    *end = 0;
+    FILE *file = fopen(path.c_str(), "rb");
+    if(!file)
+        return;
+    StatsRow r;
+    while(fread(&r, sizeof(r), 1, file) == 1)
+    {
+        *end += sizeof(r);
+        auto it = sealed.find(r.level);
+        if(it == sealed.end() || r.seq > it->second)
+            rows.push_back(r);
+    }
+    fclose(file);
+}
+
+/**************************
+ * Recording              *
+ **************************/
+
+static FILE *store, *tail;
+static string storePath, tailPath;
+static vector<StatsRow> pending;        // what the tail holds
+static uint32_t nextSeq;
+
+int statsOpen(const char *path)
+{
+    if(store)
+        return 1;
+    FILE *file = fopen(path, "ab+");
+    if(!file)
+        return 0;
+    map<int, uint32_t> sealed;
+    uint32_t lastSeq = 0;
+    long end = scanBlocks(file, [&](const StatsBlock &b, long) {
+        sealed[b.level] = max(sealed[b.level], b.lastSeq);
+        lastSeq = max(lastSeq, b.lastSeq);
+    });
+    struct stat st;
+    long size = fstat(fileno(file), &st) ? 0 : st.st_size;
+    int ok = isStore(file, end);
+    fclose(file);
+    if(!ok)
+    {
+        fprintf(stderr, "%s is not a stats store, leaving it alone\n", path);
+        return 0;
+    }
+    // Whatever follows the last whole block was being sealed when the game
+    // stopped, and its rows are still in the tail
+    if(end < size)
+    {
+        fprintf(stderr, "%s: dropping %ld bytes of a block left unfinished\n", path, size - end);
+        if(truncate(path, end))
+            return 0;
+    }
+
+    storePath = path;
+    tailPath = storePath + ".tail";
+    pending.clear();
+    readTail(tailPath, sealed, pending, &end);
+    if(truncate(tailPath.c_str(), end) && errno != ENOENT)
+        return 0;
+    for(const StatsRow &r : pending)
+        lastSeq = max(lastSeq, r.seq);
+    nextSeq = lastSeq + 1;
+
+    store = fopen(path, "ab");
+    tail = fopen(tailPath.c_str(), "ab");
+    if(!store || !tail)
+    {
+        statsClose();
+        return 0;
+    }
+    return 1;
+}
+
+void statsClose()
+{
+    if(store)
+        fclose(store);
+    if(tail)
+        fclose(tail);
+    store = tail = NULL;
+}
+
+/* Move the tail into blocks. The blocks are on disk before the tail is
+   emptied, so a crash in between only leaves rows to skip. */
+static int seal()
+{
+    stable_sort(pending.begin(), pending.end(), [](const StatsRow &a, const StatsRow &b) { return a.level < b.level; });
+    for(size_t i=0; i<pending.size(); )
+    {
+        size_t j = i;
+        while(j < pending.size() && pending[j].level == pending[i].level)
+            j++;
+        if(!writeBlock(store, &pending[i], j - i))
+            return 0;
+        i = j;
+    }
+    if(fflush(store) || fsync(fileno(store)))
+        return 0;
+    fclose(tail);
+    tail = fopen(tailPath.c_str(), "wb");
+    pending.clear();
+    return tail != NULL;
+}
+
+void statsRecord(int level, int won, int steps, double seconds)
+{
+    if(!tail)
+        return;
+    StatsRow r;
+    memset(&r, 0, sizeof(r));
+    r.seq = nextSeq++;
+    r.level = level;
+    r.ms = (uint32_t)min(max(seconds, 0.0) * 1000 + 0.5, (double)UINT32_MAX);
+    r.steps = min(max(steps, 0), 0xffff);
+    r.won = won != 0;
+    int ok = fwrite(&r, sizeof(r), 1, tail) == 1 && !fflush(tail);
+    pending.push_back(r);
+    if(ok && pending.size() >= STATS_TAIL)
+        ok = seal();
+    if(!ok)
+    {
+        fprintf(stderr, "Could not write to %s, no longer recording attempts\n", storePath.c_str());
+        statsClose();
+    }
+}
+
+/**************************
+ * Queries                *
+ **************************/
+
+static void addBlock(map<int, LevelStats> &levels, const StatsBlock &b)
+{
+    auto it = levels.find(b.level);
+    if(it == levels.end())
+    {
+        LevelStats s;
+        memset(&s, 0, sizeof(s));
+        s.bestMs = s.bestSteps = UINT32_MAX;
+        it = levels.insert(make_pair(b.level, s)).first;
+    }
+    LevelStats &s = it->second;
+    s.attempts += b.count;
+    s.wins += b.wins;
+    s.bestMs = min(s.bestMs, b.bestMs);
+    s.bestSteps = min(s.bestSteps, b.bestSteps);
+    s.worstMs = max(s.worstMs, b.worstMs);
+    s.sumMs += b.sumMs;
+    s.sumSteps += b.sumSteps;
+    for(int k=0; k<STATS_BINS; k++)
+        s.bins[k] += b.bins[k];
+}
+
+/* The headers of every block in the store, and the tail rows no block
+   holds sorted by level */
+static int readStore(const char *path, const function<void(const StatsBlock&, long)> &each, FILE **opened, vector<StatsRow> &rows)
+{
+    FILE *file = fopen(path, "rb");
+    if(!file)
+        return 0;
+    map<int, uint32_t> sealed;
+    long blocksEnd = scanBlocks(file, [&](const StatsBlock &b, long columns) {
+        sealed[b.level] = max(sealed[b.level], b.lastSeq);
+        each(b, columns);
+    });
+    if(!isStore(file, blocksEnd))
+    {
+        fclose(file);
+        return 0;
+    }
+    long end;
+    readTail(string(path) + ".tail", sealed, rows, &end);
+    stable_sort(rows.begin(), rows.end(), [](const StatsRow &a, const StatsRow &b) { return a.level < b.level; });
+    if(opened)
+        *opened = file;
+    else
+        fclose(file);
+    return 1;
+}
+
+int statsQuery(const char *path, map<int, LevelStats> &levels)
+{
+    vector<StatsRow> rows;
+    if(!readStore(path, [&](const StatsBlock &b, long) { addBlock(levels, b); }, NULL, rows))
+        return 0;
+    for(size_t i=0; i<rows.size(); )
+    {
+        size_t j = i;
+        while(j < rows.size() && rows[j].level == rows[i].level)
+            j++;
+        StatsBlock b;
+        summarize(b, &rows[i], j - i);
+        addBlock(levels, b);
+        i = j;
+    }
+    return 1;
+}
+
+int statsWinTimes(const char *path, int level, vector<uint32_t> &ms)
+{
+    vector<pair<long, uint32_t> > blocks;
+    vector<StatsRow> rows;
+    FILE *file;
+    if(!readStore(path, [&](const StatsBlock &b, long columns) {
+            if(b.level == level)
+                blocks.push_back(make_pair(columns, b.count));
+        }, &file, rows))
+        return 0;
+    vector<unsigned char> won;
+    vector<uint32_t> times;
+    int ok = 1;
+    for(auto &b : blocks)
+    {
+        uint32_t n = b.second;
+        won.resize((n + 7) / 8);
+        times.resize(n);
+        fseek(file, b.first, SEEK_SET);
+        ok = ok && fread(won.data(), 1, won.size(), file) == won.size();
+        fseek(file, b.first + won.size() + 2L*n, SEEK_SET);
+        ok = ok && fread(times.data(), 4, n, file) == n;
+        for(uint32_t i=0; ok && i<n; i++)
+            if(won[i/8] >> (i%8) & 1)
+                ms.push_back(times[i]);
+    }
+    fclose(file);
+    for(const StatsRow &r : rows)
+        if(r.level == level && r.won)
+            ms.push_back(r.ms);
+    return ok;
+}
+
+double statsPercentile(const LevelStats &s, double p)
+{
+    if(!s.wins)
+        return 0;
+    double rank = min(max(p, 0.0), 100.0) / 100 * s.wins, below = 0;
+    for(int k=0; k<STATS_BINS; k++)
+    {
+        if(!s.bins[k] || below + s.bins[k] < rank)
+        {
+            below += s.bins[k];
+            continue;
+        }
+        // Spread the bin's wins evenly over its octave fraction, within
+        // the quickest and slowest wins
+        double low = max(binLow(k), (double)s.bestMs);
+        double high = min(k+1 < STATS_BINS ? binLow(k+1) : (double)s.worstMs, (double)s.worstMs);
+        high = max(high, low);
+        double frac = (rank - below) / s.bins[k];
+        return k && low > 0 ? low * pow(high / low, frac) : low + (high - low) * frac;
+    }
+    return s.worstMs;
+}
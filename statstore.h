@@ -0,0 +1,87 @@
+#ifndef STATSTORE_H
+#define STATSTORE_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/* Player statistics: every attempt at a level, won or lost, kept for good.
+ *
+ * The game appends each attempt to a tail file (<store>.tail) as a 16 byte
+ * StatsRow. Once STATS_TAIL rows have piled up they are sealed: appended to
+ * the store as one block per level and the tail is emptied. A block is a
+ * StatsBlock header summing up its rows, followed by its rows a column at
+ * a time: a bit per row for won, then the steps as uint16s, then the times
+ * in milliseconds as uint32s, all little-endian.
+ *
+ * Queries add up the block headers, skipping the columns, and the few rows
+ * still in the tail, so they read a header for every few hundred attempts
+ * instead of the attempts themselves. Percentiles of the winning times
+ * come from a histogram with STATS_BINS_PER_OCTAVE bins to each doubling,
+ * good to about 4%.
+ *
+ * Every row has a sequence number and every block the last one it took in.
+ * A crash while sealing leaves either a torn block at the end of the store,
+ * which is cut off the next time it is opened, or tail rows a block already
+ * holds, which are skipped by their sequence number; nothing is lost or
+ * counted twice. Only what follows a whole block, or starts with a block's
+ * magic, is taken for a torn block: any other file isn't a store and is
+ * left alone.
+ */
+
+#define STATS_VERSION 1
+#define STATS_TAIL 4096
+#define STATS_BINS 128
+#define STATS_BINS_PER_OCTAVE 8
+#define STATS_BIN_MS 256        // bin 0 is anything quicker
+
+struct StatsRow {
+    uint32_t seq;
+    int32_t level;
+    uint32_t ms;
+    uint16_t steps;
+    uint8_t won;
+    uint8_t unused;
+};
+
+struct StatsBlock {
+    char magic[4];              // "BLXA", not the save's "BLXS"
+    uint32_t version;
+    int32_t level;
+    uint32_t count, wins;
+    uint32_t lastSeq;
+    uint32_t bestMs, bestSteps; // over the wins, UINT32_MAX without any
+    uint32_t worstMs;           // slowest win
+    uint32_t unused;
+    uint64_t sumMs, sumSteps;   // over the wins
+    uint32_t bins[STATS_BINS];  // wins by time, see statsBin()
+};
+
+/* What a query adds up for one level: a StatsBlock's summary without the
+   bookkeeping */
+struct LevelStats {
+    long long attempts, wins;
+    uint32_t bestMs, bestSteps, worstMs;
+    double sumMs, sumSteps;
+    long long bins[STATS_BINS];
+};
+
+/* Open the store at path for the game to record into, creating it if need
+   be. Returns 0 if it can't be opened. */
+int statsOpen(const char *path);
+void statsClose();
+/* Record one attempt; a no-op when the store isn't open */
+void statsRecord(int level, int won, int steps, double seconds);
+
+/* Sum up every level in the store at path from the block headers and the
+   tail. Returns 0 if the store can't be read. */
+int statsQuery(const char *path, std::map<int, LevelStats> &levels);
+/* The times of every win at level, read from the columns; for checking the
+   summaries against */
+int statsWinTimes(const char *path, int level, std::vector<uint32_t> &ms);
+
+int statsBin(uint32_t ms);
+/* The time p percent of the wins were quicker than, in milliseconds */
+double statsPercentile(const LevelStats &s, double p);
+
+#endif
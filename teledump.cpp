@@ -0,0 +1,110 @@
+/* Prints a telemetry log written by sample2D -telemetry, one event per
+ * line, or one summary line per play with -s.
+ *
+ *   teledump [-s] log.bin
+ */
+#include <iostream>
+#include <cstring>
+#include <ctime>
+
+#include "telemetry.h"
+
+using namespace std;
+
+static const char *eventNames[] = {
+    "?", "level", "move", "switch", "fragile", "fall", "win", "quit", "dropped", "rewind"
+};
+
+static void summary(int play, time_t when, int level, int moves, int switches, int rewinds, int dropped, const char *end, unsigned ms)
+{
+    if(play < 0)
+        return;
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&when));
+    printf("play %d  %s  level %d  %d moves  %d switches  %d rewinds  %s after %.1fs%s\n", play, stamp,
+           level, moves, switches, rewinds, end, ms / 1000.0, dropped ? "  (events dropped)" : "");
+}
+
+int main (int argc, char** argv)
+{
+    int brief = 0;
+    const char *path = NULL;
+    for(int i=1; i<argc; i++)
+    {
+        if(!strcmp(argv[i], "-s"))
+            brief = 1;
+        else
+            path = argv[i];
+    }
+    FILE *f = path ? fopen(path, "rb") : NULL;
+    if(!f)
+    {
+        fprintf(stderr, "usage: teledump [-s] log.bin\n");
+        return 2;
+    }
+
+    unsigned char record[12];
+    int play = -1, level = 0, moves = 0, switches = 0, rewinds = 0, dropped = 0;
+    const char *end = "still playing";
+    unsigned lastMs = 0;
+    time_t when = 0;
+    while(fread(record, sizeof(record), 1, f) == 1)
+    {
+        if(!memcmp(record, "BLXT", 4))
+        {
+            if(brief)
+                summary(play, when, level, moves, switches, rewinds, dropped, end, lastMs);
+            uint32_t header[3];
+            memcpy(header, record, sizeof(header));
+            if(header[1] != TELEMETRY_VERSION)
+            {
+                fprintf(stderr, "Unknown log version %u\n", header[1]);
+                return 1;
+            }
+            play++;
+            when = header[2];
+            level = moves = switches = rewinds = dropped = 0;
+            lastMs = 0;
+            end = "still playing";
+            if(!brief)
+            {
+                char stamp[32];
+                strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&when));
+                printf("# play %d, %s\n", play, stamp);
+            }
+            continue;
+        }
+
+        TelemetryEvent e;
+        memcpy(&e, record, sizeof(e));
+        lastMs = e.ms;
+        switch(e.type) {
+            case EV_LEVEL_START: level = e.value; break;
+            case EV_MOVE: moves++; break;
+            case EV_SWITCH: switches++; break;
+            case EV_FALL: end = "fell"; break;
+            case EV_WIN: end = "won"; break;
+            case EV_QUIT: end = "quit"; break;
+            case EV_DROPPED: dropped += e.value; break;
+            case EV_REWIND: rewinds++; end = "still playing"; break;
+        }
+        if(brief)
+            continue;
+        printf("%8.3f %-8s (%d,%d) pose %d steps %d", e.ms / 1000.0,
+               e.type < sizeof(eventNames)/sizeof(*eventNames) ? eventNames[e.type] : "?",
+               e.row, e.col, e.pose, e.steps);
+        if(e.type == EV_MOVE)
+            printf(" %c", e.value);
+        else if(e.type == EV_SWITCH)
+            printf(" bridges %#x", e.value);
+        else if(e.type == EV_LEVEL_START || e.type == EV_DROPPED)
+            printf(" %d", e.value);
+        else if(e.type == EV_REWIND)
+            printf(" from step %d", e.value);
+        printf("\n");
+    }
+    if(brief)
+        summary(play, when, level, moves, switches, rewinds, dropped, end, lastMs);
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include <unistd.h>
+
+#include "telemetry.h"
+
+using namespace std;
+
+#define RING_SIZE 4096     // events, a power of two
+
+static_assert(sizeof(TelemetryEvent) == 12, "the log format has 12 byte events");
+
+/* head is only written by the game thread and tail only by the writer;
+   each sits on its own cache line */
+static TelemetryEvent ring[RING_SIZE];
+alignas(64) static atomic<uint32_t> head(0);
+alignas(64) static atomic<uint32_t> tail(0);
+alignas(64) static atomic<uint32_t> dropped(0);
+static atomic<int> running(0);
+static thread writer;
+static FILE *logFile;
+static chrono::steady_clock::time_point started;
+
+static void writeLoop()
+{
+    static const chrono::milliseconds idle(10), syncEvery(1000);
+    auto lastSync = chrono::steady_clock::now();
+    TelemetryEvent batch[256];
+    for(;;)
+    {
+        int stopping = !running.load(memory_order_acquire);
+        uint32_t t = tail.load(memory_order_relaxed);
+        uint32_t h = head.load(memory_order_acquire);
+        int n = 0;
+        for(; t != h && n < 256; t++)
+            batch[n++] = ring[t & (RING_SIZE-1)];
+        tail.store(t, memory_order_release);
+
+        uint32_t lost = dropped.exchange(0, memory_order_relaxed);
+        if(lost && n < 256)
+        {
+            memset(&batch[n], 0, sizeof(batch[n]));
+            batch[n].ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started).count();
+            batch[n].type = EV_DROPPED;
+            batch[n].value = lost > 0xffff ? 0xffff : lost;
+            n++;
+        }
+        else if(lost)
+            dropped.fetch_add(lost, memory_order_relaxed);
+
+        if(n)
+            fwrite(batch, sizeof(TelemetryEvent), n, logFile);
+        auto now = chrono::steady_clock::now();
+        if(stopping || now - lastSync >= syncEvery)
+        {
+            fflush(logFile);
+            fsync(fileno(logFile));
+            lastSync = now;
+        }
+        if(stopping && t == head.load(memory_order_acquire))
+            return;
+        if(n < 256)
+            this_thread::sleep_for(idle);
+    }
+}
+
+int telemetryStart(const char *path)
+{
+    if(running)
+        return 1;
+    logFile = fopen(path, "ab");
+    if(!logFile)
+        return 0;
+    uint32_t header[3] = { 0, TELEMETRY_VERSION, (uint32_t)time(NULL) };
+    memcpy(header, "BLXT", 4);
+    fwrite(header, sizeof(header), 1, logFile);
+    started = chrono::steady_clock::now();
+    running = 1;
+    writer = thread(writeLoop);
+    return 1;
+}
+
+void telemetryStop()
+{
+    if(!running.exchange(0))
+        return;
+    writer.join();
+    fclose(logFile);
+    logFile = NULL;
+}
+
+void telemetryLog(int type, const GameState *s, int value)
+{
+    if(!running.load(memory_order_relaxed))
+        return;
+    uint32_t h = head.load(memory_order_relaxed);
+    if(h - tail.load(memory_order_acquire) == RING_SIZE)
+    {
+        dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    TelemetryEvent &e = ring[h & (RING_SIZE-1)];
+    e.ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started).count();
+    e.type = type;
+    e.row = blockRow(s);
+    e.col = blockCol(s);
+    e.pose = s->currblock;
+    e.value = value;
+    e.steps = s->numOfSteps;
+    head.store(h+1, memory_order_release);
+}
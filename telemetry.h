@@ -0,0 +1,51 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <cstdint>
+
+#include "rules.h"
+
+/* Gameplay event log.
+ *
+ * The game thread hands each event to telemetryLog(), which only copies it
+ * into a single-producer single-consumer ring; a writer thread drains the
+ * ring to the log file and fsyncs it once a second. If the writer falls so
+ * far behind that the ring fills up, events are dropped instead of making
+ * the game wait, and a DROPPED event with the count goes in their place.
+ *
+ * Every play appends a 12 byte header, "BLXT", the version and the start
+ * time in Unix seconds (4 bytes each), then one 12 byte TelemetryEvent
+ * after another, all little-endian. A record starting with "BLXT" begins
+ * the next play.
+ */
+
+#define TELEMETRY_VERSION 1
+
+#define EV_LEVEL_START 1   // value = level number
+#define EV_MOVE        2   // value = moveKey() key; pose is after the move
+#define EV_SWITCH      3   // value = bridges after the toggle
+#define EV_FRAGILE     4   // row, col = the tile that broke
+#define EV_FALL        5
+#define EV_WIN         6
+#define EV_QUIT        7
+#define EV_DROPPED     8   // value = events lost since the last record
+#define EV_REWIND      9   // undo/redo; value = numOfSteps before it
+
+struct TelemetryEvent {
+    uint32_t ms;           // since telemetryStart()
+    uint8_t type;
+    int8_t row, col;       // block position, off the board after a fall
+    uint8_t pose;          // currblock
+    uint16_t value;
+    uint16_t steps;        // numOfSteps
+};
+
+/* Start logging to path, after any plays already in it. Returns 0 if it
+   can't be opened. */
+int telemetryStart(const char *path);
+/* Write out what's left and close the log */
+void telemetryStop();
+/* Record one event about s; a no-op when logging isn't on */
+void telemetryLog(int type, const GameState *s, int value=0);
+
+#endif
@@ -0,0 +1,273 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+
+#include "world.h"
+#include "assets.h"
+
+using namespace std;
+
+enum { CHUNK_ABSENT, CHUNK_QUEUED, CHUNK_LOADING, CHUNK_DROPPED, CHUNK_DONE, CHUNK_HANDED, CHUNK_FAILED };
+
+struct World {
+    vector<WorldChunk> chunks;
+    unordered_map<long long, int> at;       // chunk at (x, y), see mapKey()
+
+    // Everything below is guarded by lock. Nothing in it is allocated
+    // once it has grown to the most chunks ever near the block.
+    mutex lock;
+    condition_variable wake;
+    vector<unsigned char> state;            // of every chunk
+    vector<int> resident;                   // the chunks near the block: not CHUNK_ABSENT,
+                                            // nor CHUNK_FAILED once out of range
+    vector<int> queue;
+    vector<LoadedChunk*> done;              // loaded, not handed over yet
+    vector<LoadedChunk*> spare;             // handed back, to load into
+    int stopping;
+    WorldStats stats;
+
+    vector<thread> loaders;
+};
+
+static long long mapKey(int x, int y)
+{
+    return (long long)x << 32 | (unsigned)y;
+}
+
+/* Division rounding down, for cells left of or above chunk (0, 0) */
+static int floorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/* Cells from (row, col) to the nearest cell of a chunk */
+static int distanceTo(const WorldChunk &c, int row, int col)
+{
+    int top = c.y * LEVEL_ROWS, left = c.x * LEVEL_COLS;
+    int dr = row < top ? top - row : max(0, row - (top + LEVEL_ROWS - 1));
+    int dc = col < left ? left - col : max(0, col - (left + LEVEL_COLS - 1));
+    return max(dr, dc);
+}
+
+/* Called with the lock held */
+static void forget(World *w, int index)
+{
+    w->state[index] = CHUNK_ABSENT;
+    auto it = find(w->resident.begin(), w->resident.end(), index);
+    *it = w->resident.back();
+    w->resident.pop_back();
+}
+
+static void loadLoop(World *w)
+{
+    unique_lock<mutex> lock(w->lock);
+    vector<int> changed;
+    for(;;)
+    {
+        w->wake.wait(lock, [w]() { return w->stopping || !w->queue.empty(); });
+        if(w->stopping)
+            return;
+        int index = w->queue.front();
+        w->queue.erase(w->queue.begin());
+        w->state[index] = CHUNK_LOADING;
+        const char *path = w->chunks[index].path.c_str();
+        LoadedChunk *c = NULL;
+        if(!w->spare.empty())
+        {
+            c = w->spare.back();
+            w->spare.pop_back();
+        }
+        lock.unlock();
+
+        if(!c)
+            c = new LoadedChunk;
+        c->index = index;
+        int ok = assetLevel(&c->start, path);
+        if(ok)
+        {
+            initBoardMesh(c->mesh);
+            syncBoardMesh(&c->start, c->mesh, changed);
+        }
+
+        lock.lock();
+        if(!ok)
+        {
+            fprintf(stderr, "Could not load %s\n", path);
+            if(w->state[index] == CHUNK_DROPPED)
+                forget(w, index);
+            w->state[index] = CHUNK_FAILED;
+            w->stats.failures++;
+            w->spare.push_back(c);
+        }
+        else if(w->state[index] == CHUNK_DROPPED)
+        {
+            forget(w, index);
+            w->spare.push_back(c);
+        }
+        else
+        {
+            w->state[index] = CHUNK_DONE;
+            w->done.push_back(c);
+            w->stats.loads++;
+        }
+    }
+}
+
+World *openWorld(const char *path, int threads)
+{
+    FILE *file = fopen(path, "r");
+    if(!file)
+        return NULL;
+    World *w = new World;
+    char line[1024], name[1024];
+    int x, y;
+    while(fgets(line, sizeof(line), file))
+    {
+        if(line[0] == '#' || sscanf(line, "%d %d %1023s", &x, &y, name) != 3)
+            continue;
+        WorldChunk c = { x, y, name };
+        if(w->at.count(mapKey(x, y)))
+            fprintf(stderr, "%s: more than one chunk at %d %d\n", path, x, y);
+        w->at[mapKey(x, y)] = w->chunks.size();
+        w->chunks.push_back(c);
+    }
+    fclose(file);
+    if(w->chunks.empty())
+    {
+        delete w;
+        return NULL;
+    }
+    w->state.assign(w->chunks.size(), CHUNK_ABSENT);
+    w->stopping = 0;
+    memset(&w->stats, 0, sizeof(w->stats));
+    for(int t=0; t<max(1, threads); t++)
+        w->loaders.push_back(thread(loadLoop, w));
+    return w;
+}
+
+void closeWorld(World *w)
+{
+    {
+        lock_guard<mutex> guard(w->lock);
+        w->stopping = 1;
+    }
+    w->wake.notify_all();
+    for(thread &t : w->loaders)
+        t.join();
+    for(LoadedChunk *c : w->done)
+        delete c;
+    for(LoadedChunk *c : w->spare)
+        delete c;
+    delete w;
+}
+
+int worldChunkCount(const World *w)
+{
+    return w->chunks.size();
+}
+
+const WorldChunk &worldChunk(const World *w, int index)
+{
+    return w->chunks[index];
+}
+
+void worldRecycle(World *w, LoadedChunk *c)
+{
+    lock_guard<mutex> guard(w->lock);
+    w->spare.push_back(c);
+}
+
+int worldChunkFailed(World *w, int index)
+{
+    lock_guard<mutex> guard(w->lock);
+    return w->state[index] == CHUNK_FAILED;
+}
+
+WorldStats worldStats(World *w)
+{
+    lock_guard<mutex> guard(w->lock);
+    return w->stats;
+}
+
+/* Called with the lock held */
+static void want(World *w, int index, int first)
+{
+    if(w->state[index] != CHUNK_ABSENT)
+        return;
+    w->state[index] = CHUNK_QUEUED;
+    w->resident.push_back(index);
+    if(first)
+        w->queue.insert(w->queue.begin(), index);
+    else
+        w->queue.push_back(index);
+}
+
+void worldUpdate(World *w, int row, int col, int next, vector<LoadedChunk*> &loaded, vector<int> &evicted)
+{
+    int queued = 0;
+    {
+        lock_guard<mutex> guard(w->lock);
+        // Nothing is evicted while it waits here: this is the only place
+        // that takes chunks out of done, and the same lock covers eviction
+        for(LoadedChunk *c : w->done)
+        {
+            w->state[c->index] = CHUNK_HANDED;
+            loaded.push_back(c);
+        }
+        w->done.clear();
+
+        // Only the map cells within reach of the block are looked at
+        size_t before = w->queue.size();
+        for(int y = floorDiv(row - WORLD_LOAD_DISTANCE, LEVEL_ROWS); y <= floorDiv(row + WORLD_LOAD_DISTANCE, LEVEL_ROWS); y++)
+            for(int x = floorDiv(col - WORLD_LOAD_DISTANCE, LEVEL_COLS); x <= floorDiv(col + WORLD_LOAD_DISTANCE, LEVEL_COLS); x++)
+            {
+                auto it = w->at.find(mapKey(x, y));
+                if(it != w->at.end() && distanceTo(w->chunks[it->second], row, col) <= WORLD_LOAD_DISTANCE)
+                    want(w, it->second, 0);
+            }
+        // The next chunk goes ahead of everything else
+        if(next >= 0)
+            want(w, next, 1);
+        queued = w->queue.size() != before;
+
+        for(size_t k=0; k<w->resident.size(); )
+        {
+            int index = w->resident[k];
+            if(index == next || distanceTo(w->chunks[index], row, col) <= WORLD_EVICT_DISTANCE)
+            {
+                k++;
+                continue;
+            }
+            switch(w->state[index]) {
+            case CHUNK_QUEUED:
+                w->queue.erase(find(w->queue.begin(), w->queue.end(), index));
+                break;
+            case CHUNK_LOADING:
+            case CHUNK_DROPPED:
+                // The loader drops it when it's done
+                w->state[index] = CHUNK_DROPPED;
+                k++;
+                continue;
+            case CHUNK_HANDED:
+                evicted.push_back(index);
+                w->stats.evictions++;
+                break;
+            }
+            // A level that failed to load stays failed, and isn't tried again
+            if(w->state[index] != CHUNK_FAILED)
+                w->state[index] = CHUNK_ABSENT;
+            w->resident[k] = w->resident.back();
+            w->resident.pop_back();
+        }
+        w->stats.resident = w->resident.size();
+        w->stats.maxResident = max(w->stats.maxResident, w->stats.resident);
+    }
+    if(queued)
+        w->wake.notify_all();
+}
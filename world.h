@@ -0,0 +1,72 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <string>
+#include <vector>
+
+#include "rules.h"
+#include "scene.h"
+
+/* Open world: levels placed side by side on one big map and played one
+ * after the other.
+ *
+ * A world file has one chunk per line, "<x> <y> <level file>", putting the
+ * level's LEVEL_ROWS x LEVEL_COLS board at chunk column x and chunk row y
+ * of the map; the level file may also be one built into the game (see
+ * assets.h). Chunks are played in the order they are listed; lines
+ * starting with # are skipped.
+ *
+ * Only chunks near the block are kept. worldUpdate() is given the block's
+ * cell on the map every frame: chunks within WORLD_LOAD_DISTANCE cells of
+ * it, and the chunk to be played next, are queued for loader threads that
+ * parse the level and bake its board mesh off the game thread. Chunks
+ * more than WORLD_EVICT_DISTANCE cells away are dropped. Finding the
+ * chunks near the block only looks at the map around it, so none of this
+ * grows with the size of the world.
+ */
+
+#define WORLD_LOAD_DISTANCE  10
+#define WORLD_EVICT_DISTANCE 25
+
+struct WorldChunk {
+    int x, y;
+    std::string path;
+};
+
+/* A chunk as the loader threads hand it over */
+struct LoadedChunk {
+    int index;
+    GameState start;        // as loaded, with the block on 'S'
+    BoardMesh mesh;         // in the level's own coordinates
+};
+
+struct WorldStats {
+    long long loads, evictions, failures;
+    int resident, maxResident;   // chunks queued, loading or handed over
+};
+
+struct World;
+
+/* Read a world file and start its loader threads. Returns NULL if the file
+   can't be read or lists no chunks. */
+World *openWorld(const char *path, int threads);
+void closeWorld(World *w);
+
+int worldChunkCount(const World *w);
+const WorldChunk &worldChunk(const World *w, int index);
+/* Hand back a chunk from worldUpdate() once done with it; its buffers are
+   used for a later load instead of being freed */
+void worldRecycle(World *w, LoadedChunk *c);
+/* Whether a chunk's level could not be loaded; it isn't tried again */
+int worldChunkFailed(World *w, int index);
+WorldStats worldStats(World *w);
+
+/* Queue and drop chunks around map cell (row, col), keeping chunk next
+   (-1 for none) as well. Chunks that finished loading since the last call
+   are appended to loaded and belong to the caller until it hands them to
+   worldRecycle(); the
+   indices of chunks dropped are appended to evicted, after anything in
+   loaded, so the caller can free them. */
+void worldUpdate(World *w, int row, int col, int next, std::vector<LoadedChunk*> &loaded, std::vector<int> &evicted);
+
+#endif